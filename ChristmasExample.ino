@@ -2,10 +2,14 @@
 
 #include "LEDSegs.cpp"
 
-//Our LED strip instance pointer
-LEDSegs* strip;
-
 const short nTotalLEDs = 160; //Total number of LEDs in the strip (160 for a 5-meter 32/meter strip uncut)
+const short nMaxSegments = 48; //Most segments any of the segment programs below defines (Christmas6 uses 40)
+
+//Our LED strip, allocated statically so nothing uses the heap, and a pointer to it. Only setup() and loop()
+//use these; the segment programs and display routines are handed the instance to work on.
+LEDSegsStatic<nTotalLEDs, nMaxSegments> christmasStrip;
+LEDSegs* lightStrip = &christmasStrip;
+
 const short nFirstLED = 0; //First LED to turn on (0-origin)
 const short nLastLED = nTotalLEDs - 1; //Max LED index to illuminate. Must be < nTotalLEDs
 const unsigned long refreshDelayMS = 35UL; //Min time between strip update cycles (in milliseconds)
@@ -16,7 +20,7 @@ unsigned static long waitforSegmentTimeMS, thisSegmentSet; //Keeps track of whic
 //four toggle switches. When the state of the switches changes, the current strip setup
 //is cleared, and the corresponding setup routine here is called to change the display
 
-typedef void (*SegmentSetupRoutine) ();
+typedef void (*SegmentSetupRoutine) (LEDSegs* strip);
 static SegmentSetupRoutine SegmentSetups[] = {
   SegmentProgramChristmas1,
   SegmentProgramChristmas5, 
@@ -36,7 +40,7 @@ const short nSegmentSets = sizeof(SegmentSetups) / sizeof(SegmentSetups[0]);
 
 /* Routine just used to tune colors */
 /*
-void SegmentProgram1StaticColor() {
+void SegmentProgram1StaticColor(LEDSegs* strip) {
   static short ColorIndex = 0;
   static uint32_t SegColors[] = {RGBPurple, RGBPurpleWhite, RGBPurpleDim, RGBPurpleVeryDim, RGBOff};
   
@@ -50,7 +54,7 @@ void SegmentProgram1StaticColor() {
 SegmentProgramChristmas1: 5 simple segments
 */
 
-void SegmentProgramChristmas1() {
+void SegmentProgramChristmas1(LEDSegs* strip) {
   short nLEDsPerSegment, iSegment;
   const short nSegments = 5;
   const short bands[nSegments] = {cSegBand2, cSegBand3, cSegBand4, cSegBand5, cSegBand6};
@@ -65,11 +69,35 @@ void SegmentProgramChristmas1() {
   }
 }
 
+//The LED intensity isn't linear with level, so this level curve gives segments that are
+//defined as static/modulate better "action". Built the first time it's asked for. It steps:
+//a level maps to C2MapLevels for the first cut it's below (the last if none), like the display
+//routine it replaced, rather than interpolating between the points as BuildLevelCurve would.
+const short* ModulateHelperCurve() {
+  const short nCuts = 9;
+  const short C2CutLevels[nCuts] = { 40, 150, 225, 400, 500, 600, 700, 800, 950};
+  const short C2MapLevels[nCuts] = {  0,   1,  10,  30,  60, 200, 400, 700, cMaxSegmentLevel};
+  static short C2Curve[cSegCurveEntries];
+  static bool builtCurve = false;
+  short iEntry, iCut;
+
+  if (!builtCurve) {
+    for (iEntry = 0; iEntry < cSegCurveEntries; iEntry++) {
+      for (iCut = 0; iCut < (nCuts - 1); iCut++) {
+        if (LEDSegs::CurveEntryLevel(iEntry) < C2CutLevels[iCut]) {break;}
+      }
+      C2Curve[iEntry] = C2MapLevels[iCut];
+    }
+    builtCurve = true;
+  }
+  return C2Curve;
+}
+
 /*
 SegmentProgramChristmas2: Pulsing solid color all spectra -- Choose a new color each call
 */
 
-void SegmentProgramChristmas2() {
+void SegmentProgramChristmas2(LEDSegs* strip) {
   short nLEDs;
   const short nColors = 6;
   uint32_t foreColors[nColors] = {RGBRed, RGBGreen, RGBBlue, RGBGold, RGBPurple, RGBWhiteDim};
@@ -80,28 +108,14 @@ void SegmentProgramChristmas2() {
 
   strip->DefineSegment(nFirstLED, nLEDs, cSegActionStatic, foreColors[thisColor], 0x0E);
   strip->SetSegment_Options(cSegOptModulateSegment);
-  strip->SetSegment_DisplayRoutine(&DisplayRoutineModulateHelper);
-}
-
-//The LED intensity isn't linear with level, so this display routine provides segments that are
-//defined as static/modulate with better "action"
-void DisplayRoutineModulateHelper(short iSegment) {
-  const short nCuts = 9;
-  const short C2CutLevels[nCuts] = { 40, 150, 225, 400, 500, 600, 700, 800, 950};
-  const short C2MapLevels[nCuts] = {  0,   1,  10,  30,  60, 200, 400, 700, cMaxSegmentLevel};
-  short iLevel, thisLevel;
-  thisLevel = strip->GetSegment_Level(iSegment);
-  for (iLevel = 0; iLevel < (nCuts-1); iLevel++) {
-    if (thisLevel < C2CutLevels[iLevel]) {break;}
-  }
-  strip->SetSegment_Level(C2MapLevels[iLevel]);
+  strip->SetSegment_LevelCurve(ModulateHelperCurve());
 }
 
 /*
 SegmentProgramChristmas3: Two interleaved red/green solid segments for all spectra, green one inverted
 */
 
-void SegmentProgramChristmas3() {
+void SegmentProgramChristmas3(LEDSegs* strip) {
   short nLEDs = nLastLED - nFirstLED + 1;
 
   strip->DefineSegment(nFirstLED, nLEDs, cSegActionFromBottom, RGBRed, cSegBand2 | cSegBand3);
@@ -115,7 +129,7 @@ void SegmentProgramChristmas3() {
 SegmentProgramChristmas4: Three segments
 */
 
-void SegmentProgramChristmas4() {
+void SegmentProgramChristmas4(LEDSegs* strip) {
   short nLEDs = nLastLED - nFirstLED + 1;
   short nLEDsPerSegment = nLEDs / 3;
 
@@ -136,7 +150,7 @@ void SegmentProgramChristmas4() {
 SegmentProgramChristmas5: 5 interleaved segments of different colors (my favorite - this is really awesome)
 */
 
-void SegmentProgramChristmas5() {
+void SegmentProgramChristmas5(LEDSegs* strip) {
   short nLEDsPerSegment, iSegment;
   const short nSegments = 5;
   const short bands[] = {cSegBand2, cSegBand3, cSegBand4, cSegBand5, cSegBand6};
@@ -160,7 +174,7 @@ short levelsChristmas6[nSegmentsChristmas6 + 1];
 short C6ColorIndex = 0;
 uint32_t C6SegColors[] = {RGBBlue, RGBGold, RGBYellow, RGBPurple, RGBOrange, RGBSilver};  //Colors to cycle
 
-void SegmentProgramChristmas6() {
+void SegmentProgramChristmas6(LEDSegs* strip) {
   short nLEDsPerSegment, iSegment, levelRangePerSegment, nLevel;
   nLEDsPerSegment = (nLastLED - nFirstLED + 1) / nSegmentsChristmas6;
   levelRangePerSegment = cMaxSegmentLevel / nSegmentsChristmas6;
@@ -179,7 +193,7 @@ void SegmentProgramChristmas6() {
   C6ColorIndex++;
 }
 
-void SegmentDisplayChristmas6(short iSegment) {
+void SegmentDisplayChristmas6(LEDSegs* strip, short iSegment) {
   short curLevel;
   curLevel = strip->GetSegment_Level(iSegment);
 //  strip->SetSegment_Action(iSegment, cSegActionStatic);
@@ -200,16 +214,17 @@ const short C7SegMinLevel = 3; //The min level needed to show the slider
 short C7ColorSegs[3];  //Records the index of the three 0-length color segments
 uint32_t C7SegColors[] = {RGBRed, RGBGreen, RGBGold, RGBYellow, RGBPurple, RGBOrange, RGBSilver, RGBBlue};  //Colors to cycle
 
-static short C7LastStartPos = 0;
-const short C7MaxAttack = 30;
-const short C7MaxDecay = 10;
+const short C7MaxAttack = 30 * cSegSliderOneLED;  //Max slider move up per cycle
+const short C7MaxDecay = 10 * cSegSliderOneLED;   //Max slider move down per cycle
 
-void SegmentProgramChristmas7() {
+void SegmentProgramChristmas7(LEDSegs* strip) {
   
   if (C7ColorIndex >= SIZEOF_ARRAY(C7SegColors)) {C7ColorIndex = 0;}
 
-  //Define the slider segment. It's color and starting position are set in the display routine
-  strip->DefineSegment(0, C7SegLen, cSegActionStatic, C7SegColors[C7ColorIndex], 0x1E);
+  //Define the slider segment over the whole strip. It's hidden in the display routine when the level is low
+  strip->DefineSegment(nFirstLED, nLastLED - nFirstLED + 1, cSegActionSlider, C7SegColors[C7ColorIndex], 0x1E);
+  strip->SetSegment_SliderLEDs(C7SegLen);
+  strip->SetSegment_SliderSlew(C7MaxAttack, C7MaxDecay);
   strip->SetSegment_DisplayRoutine(&SegmentDisplayChristmas7);
 
   //Define three zero-length segments just to get the levels for the three bands we want to
@@ -221,70 +236,48 @@ void SegmentProgramChristmas7() {
   C7ColorIndex++;
 }
 
-void SegmentDisplayChristmas7(short iSegment) {
-  short curLevel, startPos;
-  uint32_t thiscolor;
-  short colorseg, iseg, maxcolorlevel, thislevel;
-
-  curLevel = strip->GetSegment_Level(iSegment) - C7SegMinLevel;
-  if (curLevel < 0) {strip->SetSegment_Action(iSegment, cSegActionNone);}
-  else {
-    strip->SetSegment_Action(iSegment, cSegActionStatic);
-    startPos = (
-        (((long) curLevel) * ((long) (nTotalLEDs - C7SegLen))) /
-        ((long) (cMaxSegmentLevel - C7SegMinLevel))) +
-        nFirstLED;
-    startPos = constrain(startPos, 0, nLastLED); //safety
-/*    
-    if (startPos > (C7LastStartPos - C7MaxAttack)) {startPos = C7LastStartPos + C7MaxAttack;}
-    else if (startPos < (C7LastStartPos + C7MaxDecay)) {startPos = C7LastStartPos - C7MaxDecay;}
-    C7LastStartPos = startPos;
-*/    
-    strip->SetSegment_FirstLED(iSegment, startPos);
-  }
+void SegmentDisplayChristmas7(LEDSegs* strip, short iSegment) {
+  if (strip->GetSegment_Level(iSegment) < C7SegMinLevel) {strip->SetSegment_Action(iSegment, cSegActionNone);}
+  else {strip->SetSegment_Action(iSegment, cSegActionSlider);}
 }
 /*
 SegmentProgramChristmas8: Single color-modulated segment based on sound level
 */
 
-void SegmentProgramChristmas8() {
+void SegmentProgramChristmas8(LEDSegs* strip) {
+  //Red peaks at level 100, green at 750 and blue at 1023, each fading linearly to either side.
+  //These are the points where any of the three changes direction.
+  const short C8nPoints = 8;
+  static const short C8Levels[C8nPoints] = {0, 100, 550, 600, 700, 750, 800, 1023};
+  static const uint32_t C8Colors[C8nPoints] = {
+      LEDSegs::Color(  0,   0,   0), LEDSegs::Color(127,   0,   0), LEDSegs::Color( 13,   0,   0)
+    , LEDSegs::Color(  0,  32,   0), LEDSegs::Color(  0,  95,   0), LEDSegs::Color(  0, 127,  20)
+    , LEDSegs::Color(  0,   0,  39), LEDSegs::Color(  0,   0, 127)};
+  static uint32_t C8Curve[cSegCurveEntries];
+
+  LEDSegs::BuildColorCurve(C8Curve, C8Levels, C8Colors, C8nPoints);
   strip->DefineSegment(0, nTotalLEDs, cSegActionStatic, RGBOff, cSegBand2 | cSegBand3 | cSegBand4 | cSegBand5);
-  strip->SetSegment_DisplayRoutine(&SegmentDisplayChristmas8);
-}
-
-//Display routine to modulate the color.
-void SegmentDisplayChristmas8(short iSegment) {
-  const short C8nColors = 3;
-  static const short C8ColorLow[C8nColors] = {0, 550, 700};     //RGB
-  static const short C8ColorPeak[C8nColors] = {100, 750, 1023};
-  static const short C8ColorHigh[C8nColors] = {600, 800, 1023};
-  short C8RGBLevels[C8nColors];
-  short iColor, seglevel, lowval, peakval, highval;
-
-  seglevel = strip->GetSegment_Level(iSegment);  
-  for (iColor = 0; iColor < C8nColors; iColor++) {
-    lowval = C8ColorLow[iColor];
-    peakval = C8ColorPeak[iColor];
-    highval = C8ColorHigh[iColor];
-    C8RGBLevels[iColor] = 0;
-    if (seglevel > lowval) {
-      if (seglevel < peakval) {C8RGBLevels[iColor] = ((seglevel - lowval) * 127) / (peakval - lowval);}
-      else if (seglevel < highval) {C8RGBLevels[iColor] = ((highval - seglevel) * 127) / (highval - peakval);}
-    }
-  }
-  strip->SetSegment_ForeColor(iSegment, LEDSegs::Color(C8RGBLevels[0], C8RGBLevels[1], C8RGBLevels[2])); 
+  strip->SetSegment_ColorCurve(C8Curve);
 }
 
 /*
-SegmentProgramChristmas9: Simple single segment from the bottom
+SegmentProgramChristmas9: Simple single segment from the bottom, smoothed, with a falling white peak
+dot and a fading trail
 */
 
 short C9ColorIndex = 0;
 uint32_t C9SegColors[] = {RGBRed, RGBGreen, RGBGold, RGBBlue};  //Colors to cycle
+uint32_t C9TrailColors[] = {RGBRedDim, RGBGreenDim, RGBGoldDim, RGBBlueDim};
+LEDSegsHistory C9History;
+short C9TrailLevels[6];
 
-void SegmentProgramChristmas9() {  
-  if (C9ColorIndex >= SIZEOF_ARRAY(C7SegColors)) {C9ColorIndex = 0;}
+void SegmentProgramChristmas9(LEDSegs* strip) {  
+  if (C9ColorIndex >= SIZEOF_ARRAY(C9SegColors)) {C9ColorIndex = 0;}
   strip->DefineSegment(0, nTotalLEDs, cSegActionFromBottom, C9SegColors[C9ColorIndex], 0x1E);
+  strip->SetSegment_History(&C9History);
+  strip->SetSegment_Smoothing(60);
+  strip->SetSegment_PeakHold(RGBWhiteDim, 400, 600);
+  strip->SetSegment_Trail(C9TrailLevels, SIZEOF_ARRAY(C9TrailLevels), C9TrailColors[C9ColorIndex]);
   C9ColorIndex++;
 }
 
@@ -294,8 +287,8 @@ The Arduino boot setup routine
 
 void setup() {
 
-  //Create the strip class instance we will use
-  strip = new LEDSegs(nTotalLEDs);
+  //Start the strip and spectrum analyzer
+  christmasStrip.Begin();
   
   //Make sure we see a "change" to start the segment sets cycling
   thisSegmentSet = -1;
@@ -321,13 +314,13 @@ void loop() {
     waitforSegmentTimeMS = startRefreshMS + segmentSetDisplayTimeMS; //Set the time for the upcoming segment set
     thisSegmentSet++; //Move to the next segment set (cycling)
     if (thisSegmentSet >= nSegmentSets) {thisSegmentSet = 0;};
-    strip->ResetStrip();
-    SegmentSetups[thisSegmentSet]();
+    lightStrip->ResetStrip();
+    SegmentSetups[thisSegmentSet](lightStrip);
   }  
   
   //Do the deed
-  strip->DisplaySpectrum(true, true);
+  lightStrip->DisplaySpectrum(true, true);
 
-  //Wait for the minimum refresh time;
-  while (millis() < (startRefreshMS + refreshDelayMS)) {;}
+  //Oversample the analyzer while waiting for the minimum refresh time
+  while (millis() < (startRefreshMS + refreshDelayMS)) {lightStrip->SampleSpectrum();}
 }
@@ -0,0 +1,241 @@
+//Checks the LEDSegsE131 sink without a network. Everything it sends goes to a stand-in receiver that
+//validates each packet as it arrives, and the results are printed on the serial port (115200 baud).
+//
+//Copy (or link) LEDSegs.cpp and LEDSegsE131.cpp into this folder first, as the Arduino IDE only builds
+//the sketch's own folder. The 100-universe timing uses a 17000 LED strip, so it needs a Due.
+
+#define cE131MaxUniverses 100
+
+#include <SPI.h>
+#include "LEDSegs.cpp"
+#include "LEDSegsE131.cpp"
+
+const short nSmallLEDs = 340;   //Two full universes
+const short nBigLEDs = 17100;   //One universe more than cE131MaxUniverses
+const unsigned short firstUniverse = 1;
+const unsigned short syncUniverse = firstUniverse + cE131MaxUniverses;  //The sink's default when the first universe is 1
+
+byte mac[6] = {0x90, 0xA2, 0xDA, 0x00, 0x12, 0x34};
+short levelNone(LEDSegs* /*strip*/, short /*iChannel*/, short /*iBand*/) {return 0;}
+
+//Stand-in for the receiving controller. It implements the UDP interface the sink sends through and
+//checks every packet: the E1.31 headers and lengths, the CID, per-universe sequence numbers, the sync
+//packets, and (when checkData is set) that the DMX data matches the strip.
+
+class LoopbackReceiver : public UDP {
+
+  public:
+
+    LoopbackReceiver() {Reset(NULL);}
+    void Reset(LEDSegs* Strip);
+
+    LEDSegs* strip;
+    bool checkData;
+    short dataPackets, syncPackets, errors;
+
+    //The UDP interface. Only sending is used.
+    uint8_t begin(uint16_t) {return 1;}
+    void stop() {}
+    int beginPacket(IPAddress, uint16_t port) {rxLen = 0; if (port != cE131Port) {Error("port");} return 1;}
+    int beginPacket(const char*, uint16_t port) {return beginPacket(IPAddress(), port);}
+    int endPacket();
+    size_t write(uint8_t value) {return write(&value, 1);}
+    size_t write(const uint8_t *buffer, size_t size);
+    int parsePacket() {return 0;}
+    int available() {return 0;}
+    int read() {return -1;}
+    int read(unsigned char*, size_t) {return 0;}
+    int read(char*, size_t) {return 0;}
+    int peek() {return -1;}
+    void flush() {}
+    IPAddress remoteIP() {return IPAddress();}
+    uint16_t remotePort() {return 0;}
+
+  private:
+    void CheckData();
+    void CheckSync();
+    void Error(const char*);
+    unsigned short Short(short i) {return (((unsigned short) rx[i]) << 8) | rx[i + 1];}
+
+    byte rx[700];
+    short rxLen;
+    byte nextSequence[cE131MaxUniverses];
+    bool seenUniverse[cE131MaxUniverses];
+    byte nextSyncSequence;
+    bool seenSync;
+};
+
+void LoopbackReceiver::Reset(LEDSegs* Strip) {
+  short i;
+
+  strip = Strip;
+  checkData = true;
+  dataPackets = 0;
+  syncPackets = 0;
+  errors = 0;
+  for (i = 0; i < cE131MaxUniverses; i++) {seenUniverse[i] = false;}
+  seenSync = false;
+}
+
+size_t LoopbackReceiver::write(const uint8_t *buffer, size_t size) {
+  if ((rxLen + size) > sizeof(rx)) {Error("packet too long"); return 0;}
+  memcpy(&rx[rxLen], buffer, size);
+  rxLen += size;
+  return size;
+}
+
+int LoopbackReceiver::endPacket() {
+  static const byte acnId[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+  static const byte cidPrefix[10] = {'L', 'E', 'D', 'S', 'e', 'g', 's', 0, 0xE1, 0x31};
+
+  //Root layer, the same for data and sync packets
+  if (rxLen < 49) {Error("packet too short"); return 1;}
+  if ((Short(0) != 0x0010) || (Short(2) != 0) || (memcmp(&rx[4], acnId, 12) != 0)) {Error("preamble");}
+  if (Short(16) != (0x7000 | (rxLen - 16))) {Error("root length");}
+  if ((memcmp(&rx[22], cidPrefix, 10) != 0) || (memcmp(&rx[32], mac, 6) != 0)) {Error("CID");}
+
+  if ((Short(18) == 0) && (Short(20) == 0x0004)) {CheckData();}
+  else if ((Short(18) == 0) && (Short(20) == 0x0008)) {CheckSync();}
+  else {Error("root vector");}
+  return 1;
+}
+
+void LoopbackReceiver::CheckData() {
+  short iUniverse, iLED, nLEDs, i;
+  uint32_t color;
+  byte expect[3];
+
+  dataPackets++;
+  if (Short(38) != (0x7000 | (rxLen - 38))) {Error("framing length");}
+  if ((Short(40) != 0) || (Short(42) != 0x0002)) {Error("framing vector");}
+  if (rx[108] != cE131Priority) {Error("priority");}
+  if (Short(109) != syncUniverse) {Error("sync address");}
+  if (Short(115) != (0x7000 | (rxLen - 115))) {Error("DMP length");}
+  if ((rx[117] != 0x02) || (rx[118] != 0xA1) || (Short(119) != 0) || (Short(121) != 1)) {Error("DMP header");}
+  if ((Short(123) != (rxLen - 125)) || (rx[125] != 0)) {Error("slot count");}
+
+  iUniverse = Short(113) - firstUniverse;
+  if ((iUniverse < 0) || (iUniverse >= cE131MaxUniverses)) {Error("universe"); return;}
+  if (seenUniverse[iUniverse] && (rx[111] != nextSequence[iUniverse])) {Error("sequence");}
+  seenUniverse[iUniverse] = true;
+  nextSequence[iUniverse] = rx[111] + 1;
+
+  //The slots should be the strip's LEDs, RGB, scaled from 7 to 8 bits
+  if (!checkData || (strip == NULL)) {return;}
+  nLEDs = min(cE131PixelsPerUniverse, strip->GetNumLEDs() - (iUniverse * cE131PixelsPerUniverse));
+  if ((rxLen - 126) != (3 * nLEDs)) {Error("slots"); return;}
+  for (iLED = 0; iLED < nLEDs; iLED++) {
+    color = strip->GetLEDColor((iUniverse * cE131PixelsPerUniverse) + iLED);
+    LEDSegs::Colorvals(color, expect);
+    for (i = 0; i < 3; i++) {
+      expect[i] = (expect[i] << 1) | (expect[i] >> 6);
+      if (rx[126 + (3 * iLED) + i] != expect[i]) {Error("data"); return;}
+    }
+  }
+}
+
+void LoopbackReceiver::CheckSync() {
+  syncPackets++;
+  if (rxLen != 49) {Error("sync length");}
+  if ((Short(38) != (0x7000 | (rxLen - 38))) || (Short(40) != 0) || (Short(42) != 0x0001)) {Error("sync framing");}
+  if (seenSync && (rx[44] != nextSyncSequence)) {Error("sync sequence");}
+  seenSync = true;
+  nextSyncSequence = rx[44] + 1;
+  if (Short(45) != syncUniverse) {Error("sync universe");}
+}
+
+void LoopbackReceiver::Error(const char* What) {
+  errors++;
+  Serial.print("  bad packet: ");
+  Serial.println(What);
+}
+
+LoopbackReceiver receiver;
+LEDSegsE131 e131(receiver, IPAddress(127, 0, 0, 1), firstUniverse, mac);
+short failures = 0;
+
+//Show a frame and check what went out. LED 0 and LED 1 are one-LED static segments.
+
+void Frame(LEDSegs* strip, const char* What, uint32_t Color0, uint32_t Color1, short ExpectUniverses) {
+  short packetsBefore, syncsBefore;
+
+  strip->SetSegment_ForeColor(0, Color0);
+  strip->SetSegment_ForeColor(1, Color1);
+  packetsBefore = receiver.dataPackets;
+  syncsBefore = receiver.syncPackets;
+  receiver.errors = 0;
+  strip->DisplaySpectrum(true, true);
+
+  if ((e131.GetUniversesSent() != ExpectUniverses) || (receiver.dataPackets - packetsBefore != ExpectUniverses) ||
+      (receiver.syncPackets - syncsBefore != ((ExpectUniverses > 0) ? 1 : 0)) || (receiver.errors != 0)) {failures++; Serial.print("FAIL ");}
+  else {Serial.print("ok   ");}
+  Serial.print(What);
+  Serial.print(": sent ");
+  Serial.print(e131.GetUniversesSent());
+  Serial.print(", expected ");
+  Serial.println(ExpectUniverses);
+}
+
+LEDSegs* NewStrip(short nLEDs, uint32_t Background) {
+  LEDSegs* strip;
+
+  strip = new LEDSegs(nLEDs);
+  strip->SetSpectrumSource(&levelNone);
+  strip->DefineSegment(0, 1, cSegActionStatic, RGBOff, cSegBand1);
+  strip->DefineSegment(1, 1, cSegActionStatic, RGBOff, cSegBand1);
+  strip->DefineSegment(2, nLEDs - 2, cSegActionStatic, Background, cSegBand1);
+  strip->AddSink(&e131);
+  receiver.Reset(strip);
+  return strip;
+}
+
+void setup() {
+  LEDSegs* strip;
+  unsigned long waitMS;
+
+  Serial.begin(115200);
+  Serial.println("LEDSegsE131 loopback check");
+
+  //Change detection. Each case changes only universe 0, so only it should go out.
+  strip = NewStrip(nSmallLEDs, LEDSegs::Color(5, 5, 5));
+  Frame(strip, "first frame", RGBOff, RGBOff, 2);
+  Frame(strip, "unchanged", RGBOff, RGBOff, 0);
+  Frame(strip, "off -> red", RGBRed, RGBOff, 1);
+  Frame(strip, "red -> off", RGBOff, RGBOff, 1);
+  Frame(strip, "off -> blue", RGBBlue, RGBOff, 1);
+  Frame(strip, "blue -> green", RGBGreen, RGBOff, 1);
+  Frame(strip, "green -> white", RGBWhite, RGBOff, 1);
+  Frame(strip, "white -> red", RGBRed, RGBOff, 1);
+  Frame(strip, "(10,20,0)", LEDSegs::Color(10, 20, 0), RGBOff, 1);
+  Frame(strip, "(10,20,0) -> (20,10,0)", LEDSegs::Color(20, 10, 0), RGBOff, 1);
+  Frame(strip, "red, off -> off, red", RGBOff, RGBRed, 1);
+  Frame(strip, "off, red -> red, off", RGBRed, RGBOff, 1);
+
+  //Unchanged universes still go out every cE131KeepAliveMS
+  waitMS = millis();
+  while ((millis() - waitMS) < cE131KeepAliveMS) {}
+  Frame(strip, "keep-alive", RGBRed, RGBOff, 2);
+  delete strip;
+
+  //Send cost at 100 universes, with all of them changed and with none. Pixels past
+  //cE131MaxUniverses are dropped, and reported. A new background changes the first two universes too.
+  strip = NewStrip(nBigLEDs, LEDSegs::Color(6, 6, 6));
+  receiver.checkData = false;
+  Frame(strip, "100 universes", RGBOff, RGBOff, cE131MaxUniverses);
+  Serial.print("  send micros ");
+  Serial.print(e131.GetSendMicros());
+  Serial.print(", dropped ");
+  Serial.println(e131.GetUniversesDropped());
+  if (e131.GetUniversesDropped() != 1) {failures++; Serial.println("FAIL dropped universes");}
+  Frame(strip, "100 universes unchanged", RGBOff, RGBOff, 0);
+  Serial.print("  send micros ");
+  Serial.println(e131.GetSendMicros());
+  delete strip;
+
+  Serial.print((failures == 0) ? "PASSED" : "FAILED, ");
+  if (failures != 0) {Serial.print(failures); Serial.println(" failures");}
+  else {Serial.println();}
+}
+
+void loop() {
+}
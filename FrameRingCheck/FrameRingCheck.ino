@@ -0,0 +1,69 @@
+//Measures LEDSegsFrameRing throughput: how many frames per second it can publish and a reader can take,
+//and how long copying one frame takes, for a few strip lengths. The results are printed on the serial
+//port (115200 baud). Nothing needs to be connected: the strip has no outputs, so only the ring is timed.
+//
+//Copy (or link) LEDSegs.cpp into this folder first, as the Arduino IDE only builds the sketch's own folder.
+
+#include <SPI.h>
+#include "LEDSegs.cpp"
+
+const short nSlots = 4;
+const short nMaxLEDs = 240;
+const short ledCounts[] = {60, 120, 240};
+const unsigned long runMS = 2000UL;   //How long to run each case
+
+unsigned long ringBuffer[LEDSegsFrameRingLongs(nSlots, nMaxLEDs)];
+byte frame[3 * nMaxLEDs];
+
+short levelNone(LEDSegs* /*strip*/, short /*iChannel*/, short /*iBand*/) {return 0;}
+
+void Measure(short nLEDs) {
+  LEDSegs* strip;
+  LEDSegsFrameRing ring(ringBuffer, nSlots, nLEDs);
+  LEDSegsFrameReader reader(ring);
+  unsigned long startMS, elapsedMS, published, read, torn;
+
+  strip = new LEDSegs(nLEDs);
+  strip->SetSpectrumSource(&levelNone);
+  strip->DefineSegment(0, nLEDs / 2, cSegActionStatic, RGBRed, cSegBand1);
+  strip->DefineSegment(nLEDs / 2, nLEDs - (nLEDs / 2), cSegActionStatic, RGBWhiteDim, cSegBand1);
+  strip->DisplaySpectrum(true, true);
+
+  //Publish and read frames as fast as possible, without display cycles, so only the ring is measured
+  read = 0;
+  torn = 0;
+  startMS = millis();
+  while ((elapsedMS = millis() - startMS) < runMS) {
+    ring.FrameShown(strip);
+    switch (reader.ReadLatest(frame)) {
+      case cFrameRead: read++; break;
+      case cFrameTorn: torn++; break;
+    }
+  }
+  published = ring.GetFrames();
+
+  Serial.print(nLEDs);
+  Serial.print(" LEDs: published ");
+  Serial.print((published * 1000UL) / elapsedMS);
+  Serial.print(" frames/sec (");
+  Serial.print(ring.GetPublishMicros());
+  Serial.print(" micros each), read ");
+  Serial.print((read * 1000UL) / elapsedMS);
+  Serial.print(" frames/sec, torn ");
+  Serial.print(torn);
+  Serial.print(", missed ");
+  Serial.println(reader.GetMissedFrames());
+
+  delete strip;
+}
+
+void setup() {
+  short i;
+
+  Serial.begin(115200);
+  Serial.println("LEDSegsFrameRing throughput check");
+  for (i = 0; i < (short) SIZEOF_ARRAY(ledCounts); i++) {Measure(ledCounts[i]);}
+}
+
+void loop() {
+}
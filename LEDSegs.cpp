@@ -1,7 +1,7 @@
 
 //Define this library if not already defined
 #ifndef _LEDSEGS_
-  #define _LEDSEGS_ 26
+  #define _LEDSEGS_ 40
 
 /*
 Revision History [SGD]
@@ -13,6 +13,20 @@ LO23: Bug fixes
 LO24: Display Routines, code cleanup, other misc
 LO25: Fixes & support for Mega - mostly a few obscure short/long issues
 LO26: Added cSegActionRandom, cSegOptInvertLevel, a few minor fixes
+LO27: Time-based AGC, oversampling with SampleSpectrum(), noise floor auto-calibration
+LO28: Separate left/right channel levels and AGC, per-segment channel selection
+LO29: Added cSegActionSlider with slew limiting, span fills
+LO30: Multiple output strips (AddOutputChannel) with parallel output
+LO31: Display routines get the LEDSegs instance, spectrum sources, stats, LEDSegsScheduler for many instances
+LO32: Frame sinks (LEDSegsSink), LEDSegsFrameRing/LEDSegsFrameReader
+LO33: Power estimate and brightness limiter (SetPowerBudget)
+LO34: Temporal dithering (SetDithering, RefreshDither)
+LO35: Level and color response curves for segments
+LO36: LEDSegsStatic for heap-free global strips, non-blocking analyzer reset
+LO37: Stepped display routines with a per-frame time budget (SetRoutineBudget)
+LO38: Sample-to-output latency stats and percentiles, LEDSegsLatencyProbe impulse test
+LO39: Segment history: level smoothing, falling peak dots and fading trails
+LO40: Layouts (LEDSegsLayout) mapping logical and 2-D LED positions to physical spans
 
 ================
 Light organ library for the Sparkfun 32-LED/meter RGB LED strip with an Arduino Due/Mega
@@ -52,8 +66,9 @@ options can be defined for each segment to alter how that segment displays. You
 static segments or backgrounds that are not level-dependent.
 
 A note on your Arduino board: The Due and Mega are the only boards I've tried and tested. Other AVR
-boards may work, but you'll need at least about 2K SRAM and about 13K flash. Please let me know
-any results with other boards. Stack usage is modest so the compiled static allocation is most of it.
+boards may work, but you'll need about 13K flash, and SRAM for about 1K of library state plus 3 bytes
+per LED and 50 bytes per segment (see cMaxSegments). Please let me know any results with other boards.
+Stack usage is modest so the compiled static allocation is most of it.
 
 One advantage to the Mega and other AVR-based boards is that the compile and upload is much faster
 with the curent V1.5.x IDE than the Due.
@@ -135,6 +150,92 @@ You can explicitly reset the LEDSegs object at any time with a ResetStrip() call
 
   strip->ResetStrip()
 
+---------------
+Multiple Strips:
+
+Instead of chaining strips in series on one data line, you can give each strip its own pins. The time to
+update the strip grows with the number of LEDs on a line, so this keeps long installations fast. Create the
+LEDSegs object for the first strip as above, then add each of the others in setup():
+
+  strip->AddOutputChannel(#LEDs, dataPin, clockPin);  //Another strip on digital pins
+  strip->AddOutputChannel(#LEDs);                     //...or on SPI (only one strip can use SPI)
+
+The strips are joined end to end into one long "logical" strip that your segments are defined on. The
+first strip's LEDs come first, then the second strip's, etc. Segments can cross from one strip to the next.
+AddOutputChannel returns the channel index, or -1 if cMaxOutputChannels (default 4) are already defined or
+it's a second strip on SPI.
+#define cMaxOutputChannels before including this library to change that.
+
+By default the strips are updated one after the other. Call:
+
+  strip->SetOutputMode(cOutputParallel);
+
+to update all the digital pin strips at the same time, bit by bit. (The SPI strip, if any, is still updated
+on its own first.) Then the update takes about as long as the longest strip rather than the total of all of
+them. Use cOutputSequential to go back.
+
+---------------
+Static Strips:
+
+The strip object can instead be a fixed-size global object that doesn't use the heap at all. Give the number
+of LEDs and the max number of segments as template arguments, and call Begin() in setup():
+
+  LEDSegsStatic<160, 20> strip;     //SPI. Or strip(dataPin, clockPin) for digital pins.
+
+  void setup() {
+    strip.Begin();
+    ...
+  }
+
+Everything else works the same (pass &strip wherever an LEDSegs* is wanted). The LED colors are kept in a
+fixed buffer and sent by the library's own LPD8806 output code (LEDSegsStaticLPD8806), since the LPD8806
+library allocates its buffer on the heap. An optional third template argument gives a different driver class.
+It must derive from LEDSegsDriver and have a (dataPin, clockPin) constructor, with -1 pins for SPI. Strips
+added with AddOutputChannel still use the LPD8806 library and the heap.
+
+Nothing touches the hardware until Begin(), so the object can be constructed before the Arduino core is
+initialized. For either kind of strip, the spectrum analyzer's reset sequence is run a step at a time while
+the strip is cleared and sampling starts, rather than waiting in delays, so the first frame lights sooner.
+
+--------
+Layouts:
+
+Normally a segment's LEDs are numbered the way the strip is wired. When strips are folded into a zig-zag
+panel or run around doors and windows, a layout lets segments be defined in "logical" positions instead.
+It is compiled once, in setup, into a table of spans of consecutive physical LEDs, which you provide:
+
+  LEDSegsLayoutSpan spans[20];
+  LEDSegsLayout layout(spans, 20);
+
+  layout.AddGrid(16, 10, 0, cLayoutSerpentine);  //16 wide by 10 high, starting at physical LED 0
+  strip->SetLayout(&layout);                     //NULL goes back to physical numbering
+
+AddGrid numbers the grid's logical LEDs along rows from the bottom left (x + (y * width)), or up columns
+with cLayoutColumnMajor (y + (x * height)), continuing from any LEDs already in the layout. layout.XY(x, y)
+gives the logical index of a point in the last grid added. The options describe the wiring:
+
+  cLayoutColumnWired - the strip runs up the columns, rather than along the rows
+  cLayoutSerpentine  - every other row (or column) runs the opposite way, i.e. zig-zag wiring
+
+Use cLayoutColumnMajor for vertical bars, so each column is a run of consecutive logical LEDs:
+
+  strip->DefineSegment(layout.XY(3, 0), 10, cSegActionFromBottom, RGBRed, cSegBand3);  //Column 3
+
+Lay out other shapes a run at a time, in logical order:
+
+  layout.AddRun(0, 40, false);    //Logical 0..39 are physical 0..39
+  layout.AddRun(-1, 6, false);    //Logical 40..45 aren't shown (e.g. behind a pillar)
+  layout.AddRun(99, 50, true);    //Logical 46..95 are physical 99 down to 50
+
+Adjacent runs that continue each other are merged into one span. AddRun and AddGrid return false if there
+aren't enough spans. layout.GetNumLEDs() is the number of logical LEDs. Logical LEDs past the end of the
+layout aren't shown, nor are physical LEDs no logical LED maps to.
+
+Most segments are drawn with span fills, which a layout turns into a fill of each physical span the segment
+touches. Segments that use spacing, cSegActionRandom, or modulation with dithering are drawn an LED at a
+time, and each LED is looked up in the span table. Frame sinks, dithering and GetLEDColor work with
+physical LEDs.
+
 =========
 Segments:
 =========
@@ -167,6 +268,10 @@ There are five arguments to DefineSegment:
          The randomiztion stays fixed until you reinit the LEDSegs object, or you
          can explicity call the ResetRandom() method.
      
+     cSegActionSlider: a fixed-length "slider" of foreground LEDs that moves within the segment's
+         range based on level: at level 0 it is at the start of the segment, at full level at the
+         end. See Slider Segments below.
+     
      cSegActionNone:   the segment is not displayed. You would only use this with custom
          display routines (below).
 
@@ -236,8 +341,10 @@ or set a segment property.
   strip->GetSegmentIndex();  //returns the current (short integer) segment index
   strip->SetSegmentIndex(n); //sets the current segment index to segment index "n".
   
-You can define up to 100 segments. If you want a higher or lower max, use a #define to set
-cMaxSegments before including this library.
+You can define up to 40 segments. If you want a higher or lower max, use a #define to set
+cMaxSegments before including this library. (For an LEDSegsStatic strip, the max is its template argument.)
+Each segment takes 50 bytes of SRAM on AVR boards (60 on the Due), and a strip made with new reserves
+all cMaxSegments of them up front, so keep the max near what you use on smaller boards.
 
 ---------------------------
 Get/Set Segment Properties:
@@ -259,12 +366,17 @@ for the item - usually a short int.
     Get/SetSegment_Action
     Get/SetSegment_BackColor
     Get/SetSegment_Bands
+    Get/SetSegment_Channel
+        SetSegment_ColorCurve (no Get method for this)
         SetSegment_DisplayRoutine (no Get method for this)
     Get/SetSegment_FirstLED
     Get/SetSegment_ForeColor
     Get/SetSegment_Level
+        SetSegment_LevelCurve (no Get method for this)
     Get/SetSegment_NumLEDs
     Get/SetSegment_Options
+    Get/SetSegment_SliderLEDs
+        SetSegment_SliderSlew (no Get method for this)
     Get/SetSegment_Spacing
 
 Consult the class definition below to see the full list of Get/Set methods for segments.
@@ -287,6 +399,83 @@ of each successive segment by +1. This works for all actions, including Middle.
 defined integer length of all the interleaved segments MUST BE IDENTICAL in order for them to
 overlap and display correctly.
 
+----------------
+Slider Segments:
+
+A cSegActionSlider segment's FirstLED and NumLEDs give the range the slider travels in. Its length
+is set with SetSegment_SliderLEDs(n) (default 1). Foreground LEDs are the slider, the rest of the range
+is background. Spacing does not apply to sliders.
+
+Left alone, the slider jumps right to the position for the current level. To make it glide instead,
+limit how far it can move on each display cycle with SetSegment_SliderSlew(attack, decay). Attack limits
+moves toward the end of the segment (rising level), decay limits moves back toward the start. Both are in
+units of cSegSliderOneLED (1/16th of an LED), so e.g. 4 * cSegSliderOneLED is four LEDs per cycle and
+cSegSliderOneLED / 2 is one LED every other cycle. Zero (the default) means no limit.
+
+----------------
+Response Curves:
+
+A segment's level can be re-shaped, and/or its foreground color picked by level, using lookup tables
+("curves") of cSegCurveEntries (64) entries. Each costs a single table read per segment per display
+cycle. Levels n * 16 to n * 16 + 15 use entry n, which is the value for level n * 1023 / 63
+(LEDSegs::CurveEntryLevel(n)), so entry 0 is for level 0 and entry 63 for full scale (1023). A level curve
+takes 128 bytes of RAM and a color curve 256, so share them between segments.
+
+  SetSegment_LevelCurve(curve) - curve is a short array. The segment's level is replaced by the curve's
+    value for it, before any display routine is called.
+
+  SetSegment_ColorCurve(curve) - curve is a uint32_t array of colors. The segment's foreground color
+    for each display cycle is the curve's color for its level.
+
+Pass NULL to turn a curve off. Curves can be shared by any number of segments. You can write out the
+table yourself as a const array, or fill one in once in setup with these:
+
+  LEDSegs::BuildLevelCurve(curve, levels, mapLevels, n)
+      Straight lines through the n points (levels[i], mapLevels[i]). Levels below the first point map to
+      mapLevels[0], above the last to mapLevels[n-1].
+
+  LEDSegs::BuildGammaCurve(curve, gamma)
+      level^gamma, scaled to 0..1023. A gamma above 1.0 (e.g. 2.5) is good for modulated segments, since
+      the LEDs' brightness isn't linear.
+
+  LEDSegs::BuildColorCurve(curve, levels, colors, n)
+      Blend R, G and B separately between the n points (levels[i], colors[i]).
+
+For example, to make a segment go from off through red and gold to white with level:
+
+  uint32_t HeatCurve[cSegCurveEntries];
+  const short HeatLevels[] = {0, 300, 700, 1023};
+  const uint32_t HeatColors[] = {RGBOff, RGBRed, RGBGold, RGBWhite};
+
+  LEDSegs::BuildColorCurve(HeatCurve, HeatLevels, HeatColors, 4);
+  strip->SetSegment_ColorCurve(HeatCurve);
+
+----------------
+Segment History:
+
+Smoothing, peak dots and trails are built in, so they don't need display routines with their own arrays.
+They need a little memory per segment, which you provide as an LEDSegsHistory (one for each segment using
+them):
+
+  LEDSegsHistory history;
+  short trailLevels[6];
+
+  strip->SetSegment_History(&history);                   //Attach it first. NULL detaches.
+  strip->SetSegment_Smoothing(150);                      //Smooth the level with a 150ms time constant
+  strip->SetSegment_PeakHold(RGBWhite, 500, 1000);       //Peak dot: color, hold MS, fall rate in levels/sec
+  strip->SetSegment_Trail(trailLevels, 6, RGBRedDim);    //Trail of the last 6 levels, in this color
+
+Smoothing replaces the segment's level with an exponential average of it, after any level curve and before
+any display routine. The peak follows the level up, holds for the hold time, then falls at the fall rate.
+The trail keeps the segment's last few levels in a ring. Each display cycle updates these once per segment,
+after the display routines.
+
+For cSegActionFromBottom, FromTop and FromMiddle segments, the peak is drawn as a dot (one LED, or one each
+side for FromMiddle) where the fill would reach at the peak level. The trail is drawn as spans from the end of
+the fill out to each past level, dimmer with age, so a falling level leaves a fading tail. Both ignore the
+segment's spacing. Smoothing works with any action. Pass RGBOff as the peak color, or a NULL trail, to turn
+them off.
+
 ----------------
 Segment Options:
 
@@ -320,6 +509,22 @@ You can define options for the segment using the SetSegment_Options(bitmask) met
   An inverted level (ie 1023 - actuallevel) is used for the display. So higher levels reduce the number
   of LEDs, rather than increasing them.
 
+----------------
+Segment Channel:
+
+By default a segment uses the analyzer channels given to DisplaySpectrum (see below). You can instead
+pick the channel for each segment with SetSegment_Channel(channel):
+
+  cSegChannelLeft:       left channel only
+  cSegChannelRight:      right channel only
+  cSegChannelAverage:    the average of both channels
+  cSegChannelDifference: the difference between the channels, i.e. how "stereo" the sound is
+  cSegChannelDefault:    whatever DisplaySpectrum was asked for (the default)
+
+Both channels are read on each analyzer strobe, and each has its own AGC and noise floor. So for example
+the left half of the strip can follow the left channel and the right half the right channel, at no more
+sampling cost than an averaged display.
+
 ===========
 Displaying:
 ===========
@@ -330,14 +535,19 @@ Once you have the LEDSegs object created and its segments defined, just call:
   
 in the Arduino loop() routine. This queries the current values of the spectrum analyzer, and then does a
 display cycle on the LED strip with those values. doLeft and doRight are bool arguments indicating which
-channels to query in the spectrum analyzer. If both are true the two channels are averaged.
+channels to query in the spectrum analyzer for cSegChannelDefault segments. If both are true the two channels
+are averaged.
 
 You may want to put in a delay between refreshes to avoid the display refreshing too frequently. This is
 especially true with SPI output where the cycles can happen 1 or 2 ms apart, giving the display an overly
 active appearance. About 30 per refresh usually looks about right.
 
+Rather than just spinning during that delay, call SampleSpectrum(). Each call reads all seven bands once
+more and accumulates them. The next DisplaySpectrum() then "decimates" everything gathered since the last
+display cycle down to one value per band, so short beats between refreshes aren't missed.
+
 For example, here is a setup() and loop() that uses millis() to keep the time between
-display cycles to a minimum of 30ms.
+display cycles to a minimum of 30ms, oversampling the analyzer in between.
 
   void setup() {
     strip = new LEDSegs(160);
@@ -348,9 +558,36 @@ display cycles to a minimum of 30ms.
   void loop() {
     unsigned long startRefreshMS = millis();
     strip->DisplaySpectrum(true, true);
-    while (millis() < (startRefreshMS + 30UL)) {;}
+    while (millis() < (startRefreshMS + 30UL)) {strip->SampleSpectrum();}
   }
 
+_____________________
+Sampling, AGC & Noise:
+
+All of the level processing below is based on elapsed time rather than on the number of display cycles.
+So changing your refresh delay, or how often you call SampleSpectrum(), doesn't change how the display
+behaves.
+
+  SetDecimation(cSegDecimatePeak or cSegDecimateRMS)
+
+    How the samples gathered between display cycles are reduced to one per band. Peak (the default)
+    takes the loudest. RMS takes the root-mean-square, which is smoother.
+
+  SetAGC(attackMS, releaseMS)
+
+    Each band has its own max level used to normalize it to 0..cMaxSegmentLevel. When a band is louder
+    than its max, the max moves up toward it with the attack time constant. Otherwise it relaxes back
+    down toward cInitialMaxBandValue with the release time constant. Both are in milliseconds. The
+    defaults are 0 (instant attack) and 5000.
+
+  SetNoiseTracking(trackMS)
+
+    The shield's noise floor is subtracted from each band before anything else. The floor starts at
+    values found by experimentation and is then re-calibrated continuously: whenever all seven bands
+    stay within cNoiseSilenceMargin of their floors (i.e. silence), each floor moves toward the band's
+    current value with this time constant. Zero turns calibration off. The default is 2000.
+    GetNoiseFloor(channel, band) returns the current floor for cSegChannelLeft/Right and a band (0..6).
+
 _________________
 Display Routines:
 
@@ -363,7 +600,9 @@ display cycle for that segment, ie: SetSegment_DisplayRoutine(&routine-name)
 
 A display routine gets called after the spectrum samples are gathered and have been normalized
 to 0...cMaxSegmentLevel. But before the actual display processing takes place. It is a void()
-procedure that is called with a single short parameter: the index of the segment.
+procedure that is called with two parameters: a pointer to the LEDSegs object (LEDSegs*) and the
+short index of the segment. Always use that pointer rather than a global one, so the same routine
+works for any number of LEDSegs objects.
 
 A display routine can inspect and change almost any of the segment properties, including color,
 length, starting position, current normalized spectrum level, etc. These will be the values used
@@ -373,7 +612,8 @@ also inspect and change other segments as well.
 Here is an example. This was for a Christmas display. It moves a "sliding" segment up and down
 the strip. The starting position of the segment is based on the total volume level, and the
 slider segment's color is decided on each display cycle by which band has the largest amplitude.
-There is also a background of soft blue for the whole strip.
+There is also a background of soft blue for the whole strip. (Positioning like this is now built in as
+cSegActionSlider, which also does slew limiting. But it makes a good example.)
 
     //**********
     const short nFirstLED = 0;      //First LED to illuminate
@@ -399,7 +639,7 @@ There is also a background of soft blue for the whole strip.
     }
     
     //Segment's display routine called for each display cycle
-    void SegmentDisplayChristmas7(short iSegment) {
+    void SegmentDisplayChristmas7(LEDSegs* strip, short iSegment) {
       short curLevel, startPos;
       uint32_t thiscolor;
       short colorseg, iseg, maxcolorlevel, thislevel;
@@ -434,7 +674,7 @@ on this strip is bright. So a Modulate/Static segment may not show enough intens
 own to be to your liking. If so, define a display routine that re-scales spectrum samples for the
 segment. E.g.:
 
-    void DisplayRoutineModulateHelper(short iSegment) {
+    void DisplayRoutineModulateHelper(LEDSegs* strip, short iSegment) {
       const short nCuts = 6;
       const short C2CutLevels[nCuts] = {100, 200, 350, 500, 700, 950};
       const short C2MapLevels[nCuts] = {  0,   1,  15,  50, 400, cMaxSegmentLevel};
@@ -443,9 +683,216 @@ segment. E.g.:
       for (iLevel = 0; iLevel < (nCuts-1); iLevel++) {
         if (thisLevel < C2CutLevels[iLevel]) {break;}
       }
-      strip->SetSegment_Level(C2MapLevels[iLevel]);
+      strip->SetSegment_Level(iSegment, C2MapLevels[iLevel]);
     }
 
+(Level and color curves now do this kind of thing without a display routine. See Response Curves.)
+
+-------------------------
+Stepped Display Routines:
+
+A display routine runs to completion every display cycle, so a slow one holds up the whole frame. An
+expensive effect can instead be written as a stepped routine, which does its work a piece at a time:
+
+  strip->SetSegment_StepRoutine(&routine-name);
+
+  bool routine-name(LEDSegs* strip, short iSegment, short iStep) {...}
+
+Each call does one short step of work and returns true when the pass is finished, false if there is more to
+do. iStep counts the calls in the pass from 0. Keep whatever the routine works on between steps in its own
+(static) variables, and set the segment's properties in the step that finishes. A segment can have both a
+display routine and a stepped routine; the display routine runs first.
+
+Each display cycle starts a new pass of each finished stepped routine, then runs steps in turn until all are
+finished or the time budget is used:
+
+  strip->SetRoutineBudget(2000);  //Microseconds per display cycle for stepped routines. 0 (default) = no limit.
+
+A step in progress is never cut short, so keep each one well under the budget. A pass that isn't finished
+carries on where it left off, rather than starting over. Call:
+
+  strip->RunDeferredSteps(500);   //Run unfinished steps for up to 500us. Returns true when none are left.
+
+between display cycles (along with SampleSpectrum) to finish it in idle time. LEDSegsScheduler does this
+for you. Until its pass finishes, a segment is shown at the level the routine last finished with, and the
+overrun is counted in the stats (routineOverruns). So an effect that is too expensive updates less often
+rather than slowing the frame rate.
+
+================
+Spectrum Source:
+================
+
+Normally the levels come from the spectrum analyzer shield. You can supply them from anywhere else
+(another analyzer, a recording, a simulation for testing) with:
+
+  strip->SetSpectrumSource(&routine-name);
+
+The routine returns a short raw level 0..1023 and is called with a pointer to the LEDSegs object, the
+channel (cSegChannelLeft or cSegChannelRight) and the band (0..6) wanted. It is called everywhere the
+shield would have been read, and the shield isn't touched. Pass NULL to go back to the shield.
+
+=======
+Stats:
+=======
+
+  strip->GetStats(stats);   //Copy the strip's LEDSegsStats to your own LEDSegsStats "stats"
+  strip->ResetStats();
+
+LEDSegsStats has the number of display cycles done (frames), and the time in microseconds the last one
+took (frameMicros) and the longest (maxFrameMicros). Also the estimated current for the last frame in mA
+(milliAmps, before any power limiting) and the brightness scale applied by the power limiter (powerScale,
+256 = full brightness). routineOverruns counts the times a stepped display routine wasn't finished in its
+display cycle (see Stepped Display Routines). latencyMicros and maxLatencyMicros are described below.
+
+--------
+Latency:
+
+What matters on stage is the delay from a beat reaching the analyzer to the LEDs changing. Each set of
+samples is timestamped when its first sample is read, and that time is carried through the display cycle
+to when the strip has been sent. That is the frame's latency (latencyMicros in the stats, and
+maxLatencyMicros). It includes the oversampling time between display cycles, so it's the worst case for
+the frame: a beat during the last sample before the display cycle is shown sooner.
+
+The exception is a display cycle more than cMaxOversamples samples after the last. The accumulators are
+halved then so newer samples keep their weight, and the set is timestamped again, since the older samples
+now count for little in the RMS. The peaks (cSegDecimatePeak) aren't halved, though, so a beat from before
+the halving can still show, later than the latency says. Keep display cycles closer together than
+cMaxOversamples samples when the latency must be a true worst case.
+
+A histogram of the latencies, in cLatencyBucketMicros (1ms) buckets, gives percentiles:
+
+  strip->GetLatencyPercentile(50);   //Median latency in microseconds
+  strip->GetLatencyPercentile(99);
+
+The value returned is the top of the bucket the percentile falls in. Latencies over cLatencyBuckets (64)
+buckets are counted in the last one. ResetStats() clears the histogram.
+
+To measure the whole path with real beats, an LEDSegsLatencyProbe takes the place of the analyzer. It
+feeds the strip silence, then every PeriodMS an impulse (all bands at full level for cProbeImpulseMS)
+and times how long it takes until a frame is shown with the watched LED lit:
+
+  LEDSegsLatencyProbe probe(0, 1000);   //Watch LED 0, an impulse every 1000ms
+  ...
+  probe.Start(strip);                   //Uses SetSpectrumSource and AddSink
+  ...
+  probe.GetLatencyPercentile(95);       //Also GetImpulses(), GetMissed()
+  probe.Stop(strip);
+
+Set up segments so the watched LED is off in silence and lit by a loud sound (e.g. a cSegActionFromBottom
+segment starting at it). An impulse with no response within cProbeTimeoutMS is counted as missed. Each
+strip can have its own probe running at the same time, and Stop() gives the strip back whatever spectrum
+source it had before Start(). This runs on the board (or a simulation of it), so it covers everything but
+the analyzer chip and the audio path.
+
+==========
+Dithering:
+==========
+
+Colors only have 7 bits (0..127) per R/G/B, and even 1 is fairly bright, so slow fades at low levels
+step visibly. Dithering keeps each LED's color to 1/256th of a step. Each time the strip is sent, each
+color is rounded to 0..127 and the rounding error carried over to the next time. Sent often enough,
+the LED averages out to the in-between color.
+
+It needs 9 bytes of memory per LED, which you provide:
+
+  unsigned short ditherLevels[3 * 160];
+  byte ditherErrors[3 * 160];
+  ...
+  strip->SetDithering(ditherLevels, ditherErrors);  //SetDithering(NULL, NULL) turns it off
+
+Then call strip->RefreshDither() between display cycles (along with SampleSpectrum) as often as you
+can. Each call re-sends the strip with the next dither step, so the output rate is much higher than
+the display cycle rate.
+
+With dithering on, cSegOptModulateSegment segments get their foreground color from the segment's full
+0..1023 level rather than the number of lit LEDs, at the extra precision. This is where it matters most.
+
+======
+Power:
+======
+
+Full white on these strips draws about 60mA per LED -- 20mA for each of R, G and B at full (127)
+intensity. So 480 LEDs of white is nearly 30A, which will brown out most supplies. LEDSegs keeps a
+running estimate of the current as the LEDs are set on each display cycle. To keep it within what
+your supply can deliver, give it a budget in mA:
+
+  strip->SetPowerBudget(8000);  //Never draw more than about 8A. 0 (the default) is no limit.
+
+When a frame's estimate is over budget, all the LEDs are dimmed by the same proportion to fit before
+the frame is sent to the strip. cPowerMAPerChannel (default 20) is the mA for one color at full
+intensity; #define it before including this library if your strip differs.
+
+=============
+Frame Sinks:
+=============
+
+Other code can get a copy of every frame shown on the strip by deriving a class from LEDSegsSink and
+defining its FrameShown(LEDSegs* strip) method. Add it with:
+
+  strip->AddSink(&mySink);  //Returns false if cMaxSinks (default 2) are already added
+
+FrameShown is called right after each display cycle updates the strip. It can use strip->GetNumLEDs()
+and strip->GetLEDColor(iLED) to read the frame.
+
+LEDSegsFrameRing is a sink that copies each frame into a ring of frame "slots", for code that runs
+separately from the display cycle (an interrupt routine streaming frames out a serial port, say) and
+mustn't hold it up. Each slot has a sequence number that is odd while the slot is being written, so a
+reader can always tell when it got a partly written ("torn") frame, and never has to lock the writer out.
+Give it the memory to use, an unsigned long array of LEDSegsFrameRingLongs(slots, LEDs) elements:
+
+  unsigned long ringBuffer[LEDSegsFrameRingLongs(4, 160)];
+  LEDSegsFrameRing ring(ringBuffer, 4, 160);
+  ...
+  strip->AddSink(&ring);
+
+Frames are stored as 3 bytes per LED, R, G, B (0..127). It's not zero-copy: every display cycle, each LED
+is read through GetLEDColor (a virtual call) and copied into the slot, so the cost grows with the number of
+LEDs. GetPublishMicros (below) and the FrameRingCheck sketch measure it. A reader uses an
+LEDSegsFrameReader on the ring:
+
+  LEDSegsFrameReader reader(ring);
+  byte frame[3 * 160];
+  if (reader.ReadLatest(frame) == cFrameRead) {...}
+
+ReadLatest returns cFrameRead with the newest frame, cFrameNone if there's no frame newer than the last
+one read, or cFrameTorn if the writer overwrote the slot while it was being read (try again). The reader
+counts frames it never saw in GetMissedFrames(). The ring counts frames in GetFrames() and the time
+spent copying the last one in GetPublishMicros(), which gives the ring's throughput.
+
+LEDSegsE131.cpp has a sink that sends frames to Ethernet pixel controllers as E1.31 (sACN) universes.
+See the notes at the top of that file.
+
+=============================
+Many Strips: LEDSegsScheduler:
+=============================
+
+Each LEDSegs object is independent, so one board can run several of them: e.g. one per room, each
+with its own strips (AddOutputChannel), segments, and spectrum source. An LEDSegsScheduler keeps them
+all running at their own refresh rates:
+
+  LEDSegsScheduler scheduler;
+  
+  void setup() {
+    scheduler.AddStrip(hallStrip, 30, true, true);     //DisplaySpectrum(true, true) every 30ms
+    scheduler.AddStrip(porchStrip, 50, true, false);   //DisplaySpectrum(true, false) every 50ms
+  }
+
+  void loop() {
+    scheduler.Run();
+  }
+
+Each Run() call does the display cycle of the strip that is most overdue, or if none are due, oversamples
+(SampleSpectrum) for the one due next, after giving its unfinished stepped display routines up to
+cSchedulerStepMicros (RunDeferredSteps). A strip that starts its display cycle a whole refresh period late has
+missed its deadline. GetDeadlineMisses(index) returns that count for the index returned by AddStrip.
+Up to cMaxScheduledStrips (default 8) strips can be added.
+
+GetLoadPercent() returns how much of the time since the last ResetStats() was spent in display cycles.
+Past about 18 minutes (cSchedulerStatsWindowMicros) it covers only the recent part of that, so it never
+wraps; call ResetStats() at the start of each reporting window for the load over just that window. That is
+the measure for how many more strips the board can handle: e.g. four 30ms strips at a load of
+40% means about ten would fit.
+
 */
 
 #include "SPI.h"  
@@ -466,18 +913,44 @@ const short cSegBand5 = 0x10;  //2.5KHz
 const short cSegBand6 = 0x20;  //6.25KHz - Think about omitting this (6KHz is a pretty high "audible" freq.)
 const short cSegBand7 = 0x40;  //16KHz - I REALLY recommend omitting this one, just noise energy.
 
-//Software gain control constants. This provides a simple 'fast attack'/'slow decay' AGC for the input.
+//Software gain control constants. This provides an attack/release AGC for the input.
 //InitialMax is the lowest spectrum band value to which AGC processing will apply. (AGC is applied
-//separately to each of the seven spectrum bands.) As each sample is read, a fixed, assumed noise
-//value is subtracted, then the max value seen for that channel is updated, but only when it is above MaxBandValue.
-//Then the sampled value is scaled to the range (0..MaxSegmentLevel) using the actual max seen for that channel
-//so far. The decay constant is subtracted from each channel's max on each display cycle. This sample normalization
-//is applied before any custom display routine is called.
+//separately to each of the seven spectrum bands.) As each sample is decimated, the band's tracked noise
+//floor is subtracted, then the max value for that band moves toward it (attack) if it is above the max,
+//or relaxes toward InitialMax (release) otherwise. The sampled value is then scaled to the range
+//(0..MaxSegmentLevel) using that max. Attack and release are time constants in MS, so behavior doesn't depend
+//on the display cycle rate. This sample normalization is applied before any custom display routine is called.
 
 const static short cInitialMaxBandValue = 200; //Lowest max value allowed (0..1023) Normalized, after noise deduction.
-const static short cMaxBandValueDecay = 2;     //Subtracted from detected max on each sample cycle
 const short cMaxSegmentLevel = 1023;           //Normalized max sample value coming out of MapBandsToSegments()
 
+const static unsigned short cAGCAttackMS = 0;      //Default AGC attack time constant (0 = instant)
+const static unsigned short cAGCReleaseMS = 5000;  //Default AGC release time constant
+const static unsigned short cNoiseTrackMS = 2000;  //Default noise floor calibration time constant (0 = off)
+const static short cNoiseSilenceMargin = 40;       //All bands within this of their floor is considered silence
+const static short cMaxNoiseFloor = 300;           //Calibration never raises a floor above this
+const static unsigned long cMinTimeCoefQ16 = 256;  //Elapsed time is carried forward until a coefficient is this big
+
+//Max # of SampleSpectrum() reads accumulated per display cycle. Past this the accumulators are halved so
+//the newest samples still count. Keeps the RMS sums within an unsigned long.
+const static short cMaxOversamples = 64;
+
+//Analyzer channel selections for a segment (see SetSegment_Channel). Left and right are also the indexes of
+//the two physical channels.
+
+const short cSegChannelLeft = 0;
+const short cSegChannelRight = 1;
+const short cSegChannelAverage = 2;
+const short cSegChannelDifference = 3;
+const short cSegChannelDefault = 4;  //Use the channel(s) passed to DisplaySpectrum
+const short cSegNumChannels = 2;     //Physical channels
+const short cSegNumChannelSels = 4;  //Left/Right/Average/Difference
+
+//Decimation modes (see SetDecimation)
+
+const short cSegDecimatePeak = 0;  //Loudest sample since the last display cycle
+const short cSegDecimateRMS = 1;   //RMS of the samples since the last display cycle
+
 //LEDSegs Segment actions. See DefineSegment and SetSegment_Action.
 
 const short cSegActionNone = 0;        //Do nothing (undefined or do-nothing segment)
@@ -486,6 +959,15 @@ const short cSegActionFromTop = 2;     //Fill LEDs from the last down
 const short cSegActionFromMiddle = 3;  //Fill LEDs from the middle out
 const short cSegActionStatic = 4;      //Fill all LEDs in segment. Do not look at spectrum value.
 const short cSegActionRandom = 5;      //Illuminate foreground color randomly throughout the segment
+const short cSegActionSlider = 6;      //Fixed-length foreground slider positioned in the segment by level
+
+//Number of entries in a level or color response curve (see SetSegment_LevelCurve). Levels n * 16 to n * 16 + 15
+//use entry n, which is the value at CurveEntryLevel(n).
+const short cSegCurveEntries = 64;
+const short cSegCurveShift = 4;
+
+//Slider positions and slew limits are in 1/16ths of an LED (see SetSegment_SliderSlew)
+const short cSegSliderOneLED = 16;
 
 //Segment Options
 
@@ -493,17 +975,225 @@ const short cSegOptNoOffOverwrite = 0x01;
 const short cSegOptModulateSegment = 0x02;
 const short cSegOptInvertLevel = 0x04;
 
+//Output modes for multiple strips (see SetOutputMode)
+
+const short cOutputSequential = 0;  //Update each strip's LEDs in turn
+const short cOutputParallel = 1;    //Update all digital pin strips together
+
+//Max # of physical LED strips (each with its own pins) joined into one LEDSegs strip
+
+#ifndef cMaxOutputChannels
+  #define cMaxOutputChannels 4
+#endif
+
+//Estimated mA drawn by one LED color (R, G or B) at full (127) intensity. See SetPowerBudget.
+
+#ifndef cPowerMAPerChannel
+  #define cPowerMAPerChannel 20
+#endif
+
+//Max # of LEDSegsSink objects that can be added to a strip
+
+#ifndef cMaxSinks
+  #define cMaxSinks 2
+#endif
+
 //Max # of segments that can be defined for a strip. Segments are "written" to the strip in index order.
-//So higher-index segments can overwrite part or all of an lower-index segment.
+//So higher-index segments can overwrite part or all of an lower-index segment. Each is 50 bytes on AVR.
 
 #ifndef cMaxSegments
-  #define cMaxSegments 100
+  #define cMaxSegments 40
 #endif
 
+class LEDSegs;
+
 //The prototype for a pointer to a segment display customizing routine that can be defined for any segme
 //and will be called just before each strip refresh
 
-typedef void (*SegmentDisplayRoutine) (short iSegment);
+typedef void (*SegmentDisplayRoutine) (LEDSegs* strip, short iSegment);
+
+//The prototype for a stepped display routine, which does one step of its work per call and returns true
+//when finished (see SetSegment_StepRoutine)
+
+typedef bool (*SegmentStepRoutine) (LEDSegs* strip, short iSegment, short iStep);
+
+//The prototype for a pointer to a routine that supplies raw spectrum levels (0..1023) for a channel and
+//band in place of the analyzer shield. See SetSpectrumSource.
+
+typedef short (*SpectrumSourceRoutine) (LEDSegs* strip, short iChannel, short iBand);
+
+//Base class for anything that wants each frame shown on a strip (see AddSink)
+
+class LEDSegsSink {
+  public:
+    virtual void FrameShown(LEDSegs* strip) = 0;
+};
+
+//Base class for the low-level output to one physical strip. The methods match the LPD8806 library's.
+
+class LEDSegsDriver {
+  public:
+    virtual ~LEDSegsDriver() {}
+    virtual void begin() = 0;
+    virtual void show() = 0;
+    virtual void setPixelColor(uint16_t iLED, uint32_t Color) = 0;
+    virtual uint32_t getPixelColor(uint16_t iLED) = 0;
+};
+
+//Driver using the LPD8806 library, which allocates the LED buffer on the heap. Pins of -1 use SPI.
+
+class LEDSegsLPD8806 : public LEDSegsDriver {
+  public:
+    LEDSegsLPD8806(short nLEDs, short pinData, short pinClock) {
+      if (pinData < 0) {lpdStrip = new LPD8806(nLEDs);}
+      else {lpdStrip = new LPD8806(nLEDs, pinData, pinClock);}
+    }
+    ~LEDSegsLPD8806() {delete lpdStrip;}
+    void begin() {lpdStrip->begin();}
+    void show() {lpdStrip->show();}
+    void setPixelColor(uint16_t iLED, uint32_t Color) {lpdStrip->setPixelColor(iLED, Color);}
+    uint32_t getPixelColor(uint16_t iLED) {return lpdStrip->getPixelColor(iLED);}
+
+  private:
+    LPD8806* lpdStrip;
+};
+
+//Driver sending LPD8806 data from a caller's buffer of 3 bytes per LED (G, R, B), with no heap use.
+//Pins of -1 use SPI.
+
+class LEDSegsBufferLPD8806 : public LEDSegsDriver {
+  public:
+    LEDSegsBufferLPD8806(byte Pixels[], short nLEDs, short pinData, short pinClock);
+    void begin();
+    void show();
+    void setPixelColor(uint16_t iLED, uint32_t Color) {
+      if (iLED >= numLEDs) {return;}
+      pixels[3 * iLED] = (Color >> 16) & 0x7F;
+      pixels[(3 * iLED) + 1] = (Color >> 8) & 0x7F;
+      pixels[(3 * iLED) + 2] = Color & 0x7F;
+    }
+    uint32_t getPixelColor(uint16_t iLED) {
+      if (iLED >= numLEDs) {return 0;}
+      return ((uint32_t) pixels[3 * iLED] << 16) | ((uint32_t) pixels[(3 * iLED) + 1] << 8) | pixels[(3 * iLED) + 2];
+    }
+
+  private:
+    void WriteByte(byte);
+    void WriteLatch();
+
+    byte *pixels;
+    short numLEDs, dataPin, clockPin;
+#if defined __AVR__
+    volatile uint8_t *dataPort, *clockPort;
+    uint8_t dataMask, clockMask;
+#endif
+};
+
+//LEDSegsBufferLPD8806 with its own buffer, for LEDSegsStatic
+
+template <short nLEDs> class LEDSegsStaticLPD8806 : public LEDSegsBufferLPD8806 {
+  public:
+    LEDSegsStaticLPD8806(short pinData, short pinClock) : LEDSegsBufferLPD8806(pixelStore, nLEDs, pinData, pinClock) {}
+
+  private:
+    byte pixelStore[3 * nLEDs];
+};
+
+//Layout options (see LEDSegsLayout::AddGrid)
+
+const short cLayoutSerpentine = 0x01;   //Every other row (or column) is wired the opposite way
+const short cLayoutColumnWired = 0x02;  //The strip runs up the columns rather than along the rows
+const short cLayoutColumnMajor = 0x04;  //Logical LEDs are numbered up the columns rather than along the rows
+
+//A run of consecutive logical LEDs mapped to consecutive physical LEDs (see Layouts)
+
+struct LEDSegsLayoutSpan {
+  short logicalFirst;
+  short physicalFirst;  //-1 = not shown
+  short nLEDs;          //Negative when the physical LEDs run backward from physicalFirst
+};
+
+//Maps logical LED positions, including 2-D grids, to physical LEDs as a table of spans (see Layouts)
+
+class LEDSegsLayout {
+
+  public:
+
+    LEDSegsLayout(LEDSegsLayoutSpan Spans[], short MaxSpans) {spans = Spans; maxSpans = MaxSpans; Clear();}
+    void Clear() {nSpans = 0; nLogical = 0; gridFirst = 0; gridWidth = 0; gridHeight = 0; gridOptions = 0;}
+    bool AddRun(short PhysicalFirst, short nLEDs, bool Reversed);
+    bool AddGrid(short Width, short Height, short PhysicalFirst, short Options);
+
+    short XY(short x, short y) {
+      return gridFirst + ((gridOptions & cLayoutColumnMajor) ? (y + (x * gridHeight)) : (x + (y * gridWidth)));
+    }
+    short GetNumLEDs() {return nLogical;}
+    short GetNumSpans() {return nSpans;}
+    short GetPhysical(short iLogical);
+
+  private:
+    friend class LEDSegs;
+
+    bool AddLED(short);
+    short FindSpan(short);
+
+    LEDSegsLayoutSpan *spans;
+    short maxSpans, nSpans, nLogical;
+    short gridFirst, gridWidth, gridHeight, gridOptions;  //The last grid added, for XY
+};
+
+//History kept for a segment (see Segment History). Set it up with the SetSegment_ methods.
+
+struct LEDSegsHistory {
+  unsigned short smoothMS;    //Smoothing time constant (0 = none)
+  long smoothQ8;              //Smoothed level in 24.8 fixed point
+  unsigned long smoothPendingMicros;  //Time not yet applied to the smoothing
+  uint32_t peakColor;         //RGBOff = no peak dot
+  unsigned short peakHoldMS;
+  short peakFall;             //Levels per second
+  long peakQ8;                //Peak level in 24.8 fixed point
+  unsigned long peakMicros;   //When the peak was last pushed up
+  unsigned long fallPendingMicros;  //Fall time not yet applied to the peak
+  short *trailLevels;         //Ring of past levels (the caller's), NULL = no trail
+  short trailLength, trailNewest;
+  uint32_t trailColor;
+};
+
+//Latency histogram bucket size, and number of buckets (the last counts all longer latencies)
+
+const unsigned short cLatencyBucketMicros = 1000;
+
+#ifndef cLatencyBuckets
+  #define cLatencyBuckets 64
+#endif
+
+//Counts of latencies for percentiles (see Latency)
+
+class LEDSegsLatencyHistogram {
+
+  public:
+
+    LEDSegsLatencyHistogram() {Reset();}
+    void Reset();
+    void Add(unsigned long Micros);
+    unsigned long Percentile(byte Percent);
+
+  private:
+    unsigned short buckets[cLatencyBuckets];
+};
+
+//Display cycle stats for a strip (see GetStats)
+
+struct LEDSegsStats {
+  unsigned long frames;          //Display cycles done
+  unsigned long frameMicros;     //Time taken by the last display cycle
+  unsigned long maxFrameMicros;  //Longest display cycle
+  unsigned long milliAmps;       //Estimated current for the last frame, before power limiting
+  short powerScale;              //Brightness scale the power limiter applied to the last frame (256 = none)
+  unsigned long routineOverruns; //Stepped display routines not finished in their display cycle
+  unsigned long latencyMicros;   //First sample read to the strip sent, for the last display cycle
+  unsigned long maxLatencyMicros;
+};
 
 //Our LED strip class.
 
@@ -514,14 +1204,44 @@ class LEDSegs {
     //Constructor and destructor
     LEDSegs(short nLEDs) {LEDSegsInit(nLEDs, true, 0, 0);}  //Constructor with default data/clock
     LEDSegs(short nLEDs, short pinData, short pinClock) {LEDSegsInit(nLEDs, false, pinData, pinClock);}  //Constructor with explicit data/clock
-    ~LEDSegs() {delete[] objLPDStrip;}
+    ~LEDSegs();
     void LEDSegsInit(short, bool, short, short);  //Common constructor code
+    void Begin();  //Start the hardware. The constructors above do this; LEDSegsStatic strips call it in setup().
+
+    //Additional physical strips, appended to the end of the logical strip
+    short AddOutputChannel(short nLEDs) {return AddOutputChannel(nLEDs, -1, -1);}  //SPI
+    short AddOutputChannel(short, short, short);  //Explicit data/clock
+    void SetOutputMode(short Mode) {outputMode = Mode;}
+
+    //Frame sinks, and access to the frame for them
+    bool AddSink(LEDSegsSink*);
+    short GetNumLEDs() {return nLEDsInStrip;}
+    uint32_t GetLEDColor(short);
     
     void DisplaySpectrum(bool, bool);
+    void SampleSpectrum();
     void ResetStrip();
     void ResetRandom();
+
+    //Sampling, AGC and noise floor controls. Times are in MS.
+    void SetAGC(unsigned short AttackMS, unsigned short ReleaseMS) {agcAttackMS = AttackMS; agcReleaseMS = ReleaseMS;}
+    void SetNoiseTracking(unsigned short TrackMS) {noiseTrackMS = TrackMS;}
+    void SetDecimation(short Mode) {decimateMode = Mode;}
+    void SetSpectrumSource(SpectrumSourceRoutine Routine) {spectrumSource = Routine;}
+    SpectrumSourceRoutine GetSpectrumSource() {return spectrumSource;}
+
+    void GetStats(LEDSegsStats &Stats) {Stats = stripStats;}
+    void SetPowerBudget(unsigned long MilliAmps) {powerBudgetMA = MilliAmps;}
+    void SetRoutineBudget(unsigned short Micros) {routineBudgetMicros = Micros;}
+    bool RunDeferredSteps(unsigned short BudgetMicros) {return RunSteps(micros(), BudgetMicros);}
+    void SetDithering(unsigned short Levels[], byte Errors[]);
+    void SetLayout(LEDSegsLayout* Layout) {layout = Layout;}
+    void RefreshDither();
+    void ResetStats();
+    unsigned long GetLatencyPercentile(byte Percent) {return latencyHist.Percentile(Percent);}
+    short GetNoiseFloor(short iChannel, short iBand) {return noiseFloorQ8[iChannel][iBand] >> 8;}
     
-    void SetSegmentIndex(short Idx) {segCurrentIndex = constrain(Idx, 0, cMaxSegments - 1);}
+    void SetSegmentIndex(short Idx) {segCurrentIndex = constrain(Idx, 0, maxSegments - 1);}
     short GetSegmentIndex() {return segCurrentIndex;}
 
     //The SetSegment_xxx routines are overloaded. The segment # parameter can be omitted and defaults to the current index
@@ -532,8 +1252,15 @@ class LEDSegs {
     void SetSegment_BackColor(uint32_t BackColor) {SetSegment_BackColor(segCurrentIndex, BackColor);}
     void SetSegment_Bands(short nSegment, short Bands) {if (Bands >= 0) {SegmentData[nSegment].segBands = Bands;};}
     void SetSegment_Bands(short Bands) {SetSegment_Bands(segCurrentIndex, Bands);}
+    void SetSegment_Channel(short nSegment, short Channel) {if (Channel >= 0) {SegmentData[nSegment].segChannel = Channel;};}
+    void SetSegment_Channel(short Channel) {SetSegment_Channel(segCurrentIndex, Channel);}
     void SetSegment_DisplayRoutine(short nSegment, SegmentDisplayRoutine Routine) {SegmentData[nSegment].segDisplayRoutine = *Routine;}
     void SetSegment_DisplayRoutine(SegmentDisplayRoutine Routine) {SetSegment_DisplayRoutine(segCurrentIndex, Routine);}
+    void SetSegment_StepRoutine(short nSegment, SegmentStepRoutine Routine) {
+      SegmentData[nSegment].segStepRoutine = Routine;
+      SegmentData[nSegment].segStep = cSegStepFinished;
+    }
+    void SetSegment_StepRoutine(SegmentStepRoutine Routine) {SetSegment_StepRoutine(segCurrentIndex, Routine);}
     void SetSegment_FirstLED(short nSegment, short FirstLED) {if (FirstLED >= 0) {SegmentData[nSegment].segFirstLED = FirstLED;};}
     void SetSegment_FirstLED(short FirstLED) {SetSegment_FirstLED(segCurrentIndex, FirstLED);}
     void SetSegment_ForeColor(short nSegment, uint32_t ForeColor) {if (ForeColor != 0xFFFFFFFF) {SegmentData[nSegment].segForeColor = ForeColor;};}
@@ -544,17 +1271,42 @@ class LEDSegs {
     void SetSegment_NumLEDs(short nLEDs) {SetSegment_NumLEDs(segCurrentIndex, nLEDs);}
     void SetSegment_Options(short nSegment, short Options) {if (Options >= 0) {SegmentData[nSegment].segOptions = Options;};}
     void SetSegment_Options(short Options) {SetSegment_Options(segCurrentIndex, Options);}
+    void SetSegment_SliderLEDs(short nSegment, short nLEDs) {if (nLEDs >= 0) {SegmentData[nSegment].segSliderLEDs = nLEDs;};}
+    void SetSegment_SliderLEDs(short nLEDs) {SetSegment_SliderLEDs(segCurrentIndex, nLEDs);}
+    void SetSegment_SliderSlew(short nSegment, short Attack, short Decay) {
+      if (Attack >= 0) {SegmentData[nSegment].segSliderAttack = Attack;}
+      if (Decay >= 0) {SegmentData[nSegment].segSliderDecay = Decay;}
+    }
+    void SetSegment_SliderSlew(short Attack, short Decay) {SetSegment_SliderSlew(segCurrentIndex, Attack, Decay);}
+    void SetSegment_LevelCurve(short nSegment, const short* Curve) {SegmentData[nSegment].segLevelCurve = Curve;}
+    void SetSegment_LevelCurve(const short* Curve) {SetSegment_LevelCurve(segCurrentIndex, Curve);}
+    void SetSegment_ColorCurve(short nSegment, const uint32_t* Curve) {SegmentData[nSegment].segColorCurve = Curve;}
+    void SetSegment_ColorCurve(const uint32_t* Curve) {SetSegment_ColorCurve(segCurrentIndex, Curve);}
     void SetSegment_Spacing(short nSegment, short Spacing) {if (Spacing >= 0) {SegmentData[nSegment].segSpacing = Spacing;};}
     void SetSegment_Spacing(short Spacing) {SetSegment_Spacing(segCurrentIndex, Spacing);}
+    void SetSegment_History(short nSegment, LEDSegsHistory* History);
+    void SetSegment_History(LEDSegsHistory* History) {SetSegment_History(segCurrentIndex, History);}
+    void SetSegment_Smoothing(short nSegment, unsigned short TimeMS) {
+      if (SegmentData[nSegment].segHistory != NULL) {SegmentData[nSegment].segHistory->smoothMS = TimeMS;}
+    }
+    void SetSegment_Smoothing(unsigned short TimeMS) {SetSegment_Smoothing(segCurrentIndex, TimeMS);}
+    void SetSegment_PeakHold(short nSegment, uint32_t PeakColor, unsigned short HoldMS, short FallPerSec);
+    void SetSegment_PeakHold(uint32_t PeakColor, unsigned short HoldMS, short FallPerSec) {
+      SetSegment_PeakHold(segCurrentIndex, PeakColor, HoldMS, FallPerSec);
+    }
+    void SetSegment_Trail(short nSegment, short Levels[], short nLevels, uint32_t TrailColor);
+    void SetSegment_Trail(short Levels[], short nLevels, uint32_t TrailColor) {SetSegment_Trail(segCurrentIndex, Levels, nLevels, TrailColor);}
 
     short    GetSegment_Action(short nSegment)    {return SegmentData[nSegment].segAction;}
     uint32_t GetSegment_BackColor(short nSegment) {return SegmentData[nSegment].segBackColor;}
     short    GetSegment_Bands(short nSegment)     {return SegmentData[nSegment].segBands;}
+    short    GetSegment_Channel(short nSegment)   {return SegmentData[nSegment].segChannel;}
     short    GetSegment_FirstLED(short nSegment)  {return SegmentData[nSegment].segFirstLED;}
     uint32_t GetSegment_ForeColor(short nSegment) {return SegmentData[nSegment].segForeColor;}
     short    GetSegment_Level(short nSegment)     {return SegmentData[nSegment].segLevel;}
     short    GetSegment_NumLEDs(short nSegment)   {return SegmentData[nSegment].segNumLEDs;}
     short    GetSegment_Options(short nSegment)   {return SegmentData[nSegment].segOptions;}
+    short    GetSegment_SliderLEDs(short nSegment) {return SegmentData[nSegment].segSliderLEDs;}
     short    GetSegment_Spacing(short nSegment)   {return SegmentData[nSegment].segSpacing;}
 
     //Initialize a new segment and return the index # of the segment defined.
@@ -581,37 +1333,113 @@ class LEDSegs {
       rgbvals[2] = (Color & 0x7F);
     }
 
-  private:
-    const static short cSpectrumReset=5;
-    const static short cSpectrumStrobe=4;
-    
+    //Fill in response curves (cSegCurveEntries long) for SetSegment_LevelCurve/ColorCurve
+    static short CurveEntryLevel(short iEntry) {return (((long) iEntry) * cMaxSegmentLevel) / (cSegCurveEntries - 1);}
+    static void BuildLevelCurve(short Curve[], const short Levels[], const short MapLevels[], short nPoints);
+    static void BuildGammaCurve(short Curve[], float Gamma);
+    static void BuildColorCurve(uint32_t Curve[], const short Levels[], const uint32_t Colors[], short nPoints);
+
+  protected:
     struct stripSegment {
       short segFirstLED;    //The first LED in the segment from the beginning (0-origin)
       short segNumLEDs;  //The number of LEDs in the segment
       uint32_t segForeColor;     //The base color of the segment's LEDs
       uint32_t segBackColor;     //Background color
       short segBands;       //The spectrum bands that are averaged together to make up the value for the segment
+      short segChannel;     //The analyzer channel selection the bands are taken from (cSegChannel...)
       short segAction;      //The way the LEDs in the segment are populated
       short segSpacing;     //Spacing between LEDs that are illuminated in the segment (0 default = no spacing)
       short segOptions;     //Options for the segment (cSegOpt...)
+      short segSliderLEDs;  //Length of a cSegActionSlider segment's slider
+      long segSliderPos;    //Current slider offset from segFirstLED, in 1/16 LEDs
+      short segSliderAttack, segSliderDecay;  //Max slider move per display cycle up/down, in 1/16 LEDs (0 = no limit)
+      const short* segLevelCurve;      //Optional level -> level lookup table
+      const uint32_t* segColorCurve;   //Optional level -> foreground color lookup table
+      LEDSegsHistory* segHistory;      //Optional smoothing/peak/trail state
       SegmentDisplayRoutine segDisplayRoutine;  //Optional routine to call just before each display cycle
+      SegmentStepRoutine segStepRoutine;        //Optional stepped routine (see RunSteps)
+      short segStep;        //Next step of the stepped routine's pass, or cSegStepFinished
+      short segDoneLevel;   //Level when the stepped routine last finished a pass
       short segLevel, segMaxLevel;       //Normalized & max level -- output from MapBandsToSegments
     };
 
+    //For LEDSegsStatic: no output channels yet, and the segment array is the caller's
+    LEDSegs(stripSegment Segments[], short nSegments) {InitState(Segments, nSegments);}
+    short AddDriver(LEDSegsDriver*, short, short, short);
+    bool CanAddChannel(short);
+
+  private:
+    const static short cSpectrumReset=5;
+    const static short cSpectrumStrobe=4;
+    
     short segCurrentIndex;    //The "current" (default) index that will be modified
     short segMaxDefinedIndex; //Tracks the highest index defined
-    stripSegment SegmentData[cMaxSegments];  //The segment array
+    stripSegment *SegmentData;  //The segment array
+    short maxSegments;
+    bool ownSegmentData;        //SegmentData was allocated by us
+    void InitState(stripSegment[], short);
+
+    //Spectrum analyzer reset sequence, run a step at a time (see ServiceAnalyzerReset)
+    const static short cAnalyzerResetSteps = 6;
+    const static unsigned short cAnalyzerStepMicros = 100;
+    short analyzerResetStep;          //Next step to do, cAnalyzerResetSteps when done
+    unsigned long analyzerStepMicros; //When the last step was done
+    bool ServiceAnalyzerReset();
+    bool hardwareStarted;             //Begin() has been called
     
-    //The per-band level from the spectrum analyzer for the current sample (see ReadSpectrum)
-    short SpectrumLevel[cSegNumBands];
+    //The per-band level from the spectrum analyzer for the current sample (see ReadSpectrum), and the
+    //max used to normalize it. Indexed by channel selection (cSegChannelLeft...Difference) and band.
+    short SpectrumLevel[cSegNumChannelSels][cSegNumBands];
+    short maxBandValue[cSegNumChannelSels][cSegNumBands];
     
-    //Max value seen for each spectrum band so far. Used to implement a simple adaptive AGC.
-    short maxBandValue[cSegNumBands];
+    //AGC max for each physical channel and band, in 24.8 fixed point
+    long maxBandValueQ8[cSegNumChannels][cSegNumBands];
 
-    //Maximum noise values for each band. A band spectrum value of this or lower cause no illumination
-    //These were determined by experimentation.
-    short nNoiseFloor[cSegNumBands];
+    //Noise floor for each band in 24.8 fixed point. A band spectrum value of this or lower cause no illumination.
+    //Seeded with values determined by experimentation, then calibrated during silence.
+    long noiseFloorQ8[cSegNumChannels][cSegNumBands];
     
+    //Oversampling accumulators, reset by each ReadSpectrum (see SampleSpectrum)
+    short sampleCount;
+    short samplePeak[cSegNumChannels][cSegNumBands];
+    unsigned long sampleSumSq[cSegNumChannels][cSegNumBands];
+    bool sampleLeft, sampleRight;  //Channels SampleSpectrum reads, as needed by the defined segments
+    short defaultChannel;          //Channel selection for cSegChannelDefault segments (-1 = none)
+
+    //AGC / calibration settings and the time they were last applied
+    unsigned short agcAttackMS, agcReleaseMS, noiseTrackMS;
+    short decimateMode;
+    unsigned long agcLastMicros;
+    unsigned long frameElapsedMicros;  //Time between the last two display cycles
+    unsigned long attackPendingMicros, releasePendingMicros, trackPendingMicros;  //Time not yet applied (see PendingCoefQ16)
+
+    SpectrumSourceRoutine spectrumSource;  //NULL for the analyzer shield
+    LEDSegsStats stripStats;
+
+    //When the first sample of the set being accumulated was read, and of the set being displayed
+    unsigned long sampleSetMicros, frameSampleMicros;
+    LEDSegsLatencyHistogram latencyHist;
+
+    //Sum of the R+G+B values of every LED in the strip, kept up to date as LEDs are set
+    unsigned long powerSum;
+    unsigned long powerBudgetMA;  //0 = no limit
+    void LimitPower();
+
+    //Stepped display routines: the time allowed each display cycle, and the segment whose routine runs next
+    const static short cSegStepFinished = -1;
+    unsigned short routineBudgetMicros;  //0 = no limit
+    short stepSegment;
+    bool RunSteps(unsigned long, unsigned short);
+
+    //Dithering: per-LED R,G,B colors in 7.8 fixed point and the rounding error carried between refreshes.
+    //NULL when dithering is off.
+    unsigned short *ditherLevels;
+    byte *ditherErrors;
+    short ditherScale;  //Power limiter's scale, applied as the dithered colors are sent
+    void SetLEDQ8(short, unsigned short[]);
+    void DitherStep();
+    static short ColorWeight(uint32_t Color) {return (Color & 0x7F) + ((Color >> 8) & 0x7F) + ((Color >> 16) & 0x7F);}
+
     //Spectrum analyzer left/right channels
     const static short cSegSpectrumAnalogLeft=0;  //Left channel
     const static short cSegSpectrumAnalogRight=1; //Right channel
@@ -619,15 +1447,70 @@ class LEDSegs {
     void MapBandsToSegments();
     void ReadSpectrum(bool, bool);
     void ShowSegments();
+    void ShowSlider(stripSegment*, short, uint32_t, bool);
+    void FillSpan(short, short, uint32_t);
+    void UpdateHistory(stripSegment*);
+    void ShowHistory(stripSegment*, short, bool);
+    void FillLevelSpan(stripSegment*, short, short, uint32_t);
+    static short LevelToLEDs(short Level, short nLEDs) {
+      return constrain((((long) Level) * ((long) (nLEDs + 1))) / ((long) (cMaxSegmentLevel + 1)), 0, nLEDs);
+    }
+    static unsigned long TimeCoefQ16(unsigned long, unsigned short);
+    static unsigned long PendingCoefQ16(unsigned long&, unsigned long, unsigned short);
+    static long ScaleQ16(long, unsigned long);
+    static unsigned short ISqrt(unsigned long);
     
-    //A pointer to the low-level I/O LBD8806 strip object we talk to
-    LPD8806* objLPDStrip;
-    short nLEDsInStrip;
+    //The physical strips making up the logical strip, each with the low-level I/O LPD8806 strip object we talk to.
+    //pinData/pinClock are -1 for SPI.
+    struct outputChannel {
+      LEDSegsDriver* objLPDStrip;
+      bool ownDriver;       //objLPDStrip was allocated by us
+      short firstLED;       //Index of the strip's first LED in the logical strip
+      short nLEDs;
+      short pinData, pinClock;
+#if defined __AVR__
+      volatile uint8_t *dataPort, *clockPort;  //Direct port access for parallel output. digitalWrite is too slow.
+      uint8_t dataMask, clockMask;
+#endif
+    };
+    outputChannel OutputChannels[cMaxOutputChannels];
+    short nOutputChannels;
+    short outputMode;
+    short nLEDsInStrip;     //Total for all strips
+
+    LEDSegsSink* Sinks[cMaxSinks];
+    short nSinks;
+
+    void SetLED(short, uint32_t);
+    void SetPhysicalLED(short, uint32_t);
+    void FillPhysical(short, short, uint32_t);
+    LEDSegsLayout* layout;  //NULL = segments use physical LED numbers
+    void ShowOutputChannels();
+    void ShowParallel();
+    void WriteParallel(byte[], short);
     
     //Array of random cutoff levels (for cSegActionRandom)
     unsigned short segRandomLevels[64];  //Changing this requires code changes
 };
 
+//A strip whose segments and LED buffer are allocated statically, for a global object (see Static Strips).
+//Driver must derive from LEDSegsDriver and have a (pinData, pinClock) constructor.
+
+template <short nLEDs, short nSegments, class Driver = LEDSegsStaticLPD8806<nLEDs> >
+class LEDSegsStatic : public LEDSegs {
+
+  public:
+
+    LEDSegsStatic() : LEDSegs(segmentStore, nSegments), driver(-1, -1) {AddDriver(&driver, nLEDs, -1, -1);}
+    LEDSegsStatic(short pinData, short pinClock) : LEDSegs(segmentStore, nSegments), driver(pinData, pinClock) {
+      AddDriver(&driver, nLEDs, pinData, pinClock);
+    }
+
+  private:
+    stripSegment segmentStore[nSegments];
+    Driver driver;
+};
+
 //Various colors. The bit format of these is defined by the LPD8806 library.
 //Assume nothing about the format except they are an unsigned long int and 0..127
 
@@ -680,54 +1563,348 @@ const uint32_t RGBPurpleVeryDim =  LEDSegs::Color( 1,  0,  1);
 //General macros
 #define SIZEOF_ARRAY(ary) (sizeof(ary) / sizeof(ary[ 0 ]))
 
-/*______________
-LEDSegsInit:Common constructor code
-*/
+//Max # of LEDSegs objects one LEDSegsScheduler can run
 
-void LEDSegs::LEDSegsInit(short nLEDs, bool useSPI, short pinData, short pinClock) {
-  unsigned short iBand;
-  
-  segCurrentIndex = 0;
-  segMaxDefinedIndex = -1;
+#ifndef cMaxScheduledStrips
+  #define cMaxScheduledStrips 8
+#endif
 
-  //Noise values for each spectrum band (0..1023). Determined by experimentation. YMMV
-  nNoiseFloor[0] =  90;
-  nNoiseFloor[1] =  90;
-  nNoiseFloor[2] =  90;
-  nNoiseFloor[3] = 100;
-  nNoiseFloor[4] = 100;
-  nNoiseFloor[5] = 110;
-  nNoiseFloor[6] = 120;
-    
-  //Initialize the max level seen for each band.
-  for (iBand = 0; iBand < cSegNumBands; iBand++) {maxBandValue[iBand] = cInitialMaxBandValue;}
+//Most time LEDSegsScheduler::Run spends on a strip's unfinished stepped display routines when idle
+const unsigned short cSchedulerStepMicros = 1000;
 
-  //Create an LED strip object. Either SPI or digital pins
+//Longest load window (about 18 minutes). The micros() counters wrap at about 71.
+const unsigned long cSchedulerStatsWindowMicros = 0x40000000UL;
 
-  if (useSPI) {objLPDStrip = new LPD8806(nLEDs);}
-  else {objLPDStrip = new LPD8806(nLEDs, pinData, pinClock);}
-  
-  
-  nLEDsInStrip = nLEDs;
-  
-  //Setup pins to drive the spectrum analyzer. 
-  pinMode(cSpectrumReset, OUTPUT);
-  pinMode(cSpectrumStrobe, OUTPUT);
+//Runs the display cycles of several LEDSegs objects, each at its own refresh rate
 
-  //Init spectrum analyzer to start reading from lowest band
-  digitalWrite(cSpectrumStrobe,LOW);
-    delay(1);
-  digitalWrite(cSpectrumReset,HIGH);
-    delay(1);
-  digitalWrite(cSpectrumStrobe,HIGH);
-    delay(1);
-  digitalWrite(cSpectrumStrobe,LOW);
-    delay(1);
-  digitalWrite(cSpectrumReset,LOW);
-    delay(5);
-
-  //Init this guy
-  ResetStrip();
+class LEDSegsScheduler {
+
+  public:
+
+    LEDSegsScheduler() {nStrips = 0; ResetStats();}
+
+    short AddStrip(LEDSegs*, unsigned short, bool, bool);
+    void Run();
+
+    unsigned long GetDeadlineMisses(short iStrip) {return Strips[iStrip].deadlineMisses;}
+    short GetLoadPercent();
+    void ResetStats();
+
+  private:
+    struct scheduledStrip {
+      LEDSegs* strip;
+      unsigned long periodMicros;
+      unsigned long dueMicros;       //When the next display cycle should start
+      unsigned long deadlineMisses;  //Display cycles started a whole period late
+      bool doLeft, doRight;          //DisplaySpectrum arguments
+    };
+
+    scheduledStrip Strips[cMaxScheduledStrips];
+    short nStrips;
+    unsigned long statsStartMicros, busyMicros;
+};
+
+//Size in unsigned longs of the memory for an LEDSegsFrameRing: each slot is a sequence number and the RGB bytes
+
+#define LEDSegsFrameRingSlotLongs(nLEDs) (1 + (((3 * (nLEDs)) + 3) / 4))
+#define LEDSegsFrameRingLongs(nSlots, nLEDs) ((nSlots) * LEDSegsFrameRingSlotLongs(nLEDs))
+
+//LEDSegsFrameReader::ReadLatest results
+
+const short cFrameNone = 0;  //No new frame since the last one read
+const short cFrameRead = 1;  //Got the newest frame
+const short cFrameTorn = 2;  //The frame was overwritten while being read; try again
+
+//A sink that keeps the last few frames in a ring of slots (see Frame Sinks)
+
+class LEDSegsFrameRing : public LEDSegsSink {
+
+  public:
+
+    LEDSegsFrameRing(unsigned long Buffer[], short nSlots, short nLEDs);
+    void FrameShown(LEDSegs* strip);
+
+    unsigned long GetFrames() {return ReadLong(&ringFrames);}
+    unsigned long GetPublishMicros() {return publishMicros;}
+
+  private:
+    friend class LEDSegsFrameReader;
+
+    volatile unsigned long* SlotSeq(short iSlot) {return &ringBuffer[iSlot * slotLongs];}
+    static unsigned long ReadLong(volatile unsigned long *Value);
+    volatile byte* SlotData(short iSlot) {return (volatile byte*) &ringBuffer[(iSlot * slotLongs) + 1];}
+
+    unsigned long *ringBuffer;
+    short ringSlots, ringLEDs, slotLongs;
+    volatile unsigned long ringFrames;  //Frames published. Frame n (1 origin) is in slot (n-1) % ringSlots.
+    unsigned long publishMicros;
+};
+
+//Reads frames from an LEDSegsFrameRing without ever blocking its writer
+
+class LEDSegsFrameReader {
+
+  public:
+
+    LEDSegsFrameReader(LEDSegsFrameRing &Ring) : ring(Ring) {lastFrame = 0; missedFrames = 0;}
+    short ReadLatest(byte Frame[]);
+    unsigned long GetMissedFrames() {return missedFrames;}
+
+  private:
+    LEDSegsFrameRing &ring;
+    unsigned long lastFrame, missedFrames;
+};
+
+//LEDSegsLatencyProbe impulse length and how long to wait for a response to one
+
+const unsigned short cProbeImpulseMS = 20;
+const unsigned short cProbeTimeoutMS = 500;
+
+//Feeds a strip impulses in place of the analyzer and times the response (see Latency)
+
+class LEDSegsLatencyProbe : public LEDSegsSink {
+
+  public:
+
+    LEDSegsLatencyProbe(short WatchLED, unsigned short PeriodMS);
+    void Start(LEDSegs* strip);
+    void Stop(LEDSegs* strip);
+    void FrameShown(LEDSegs* strip);
+
+    unsigned long GetLatencyPercentile(byte Percent) {return latencyHist.Percentile(Percent);}
+    unsigned long GetImpulses() {return impulses;}
+    unsigned long GetMissed() {return missed;}
+
+  private:
+    static short SpectrumLevel(LEDSegs* strip, short iChannel, short iBand);
+
+    //Started probes, so SpectrumLevel can find the one for its strip
+    static LEDSegsLatencyProbe* firstStarted;
+    LEDSegsLatencyProbe* nextStarted;
+    LEDSegs* probeStrip;                  //NULL when not started
+    LEDSegs* sinkStrip;                   //The strip the probe was last added to as a sink
+    SpectrumSourceRoutine savedSource;    //The strip's spectrum source before Start
+
+    short watchLED;
+    unsigned short periodMS;
+    bool impulsePending;
+    unsigned long nextImpulseMS, impulseMicros;
+    unsigned long impulses, missed;
+    LEDSegsLatencyHistogram latencyHist;
+};
+
+/*______________
+LEDSegsInit:Common constructor code
+*/
+
+void LEDSegs::LEDSegsInit(short nLEDs, bool useSPI, short pinData, short pinClock) {
+  InitState(new stripSegment[cMaxSegments], cMaxSegments);
+  ownSegmentData = true;
+
+  //Create the first LED strip object. Either SPI or digital pins
+  if (useSPI) {AddOutputChannel(nLEDs);}
+  else {AddOutputChannel(nLEDs, pinData, pinClock);}
+
+  Begin();
+}
+
+/*_________________
+LEDSegs::InitState
+Set up everything but the hardware and output channels
+*/
+
+void LEDSegs::InitState(stripSegment Segments[], short nSegments) {
+  unsigned short iBand, iChannel;
+  short iSegment;
+  
+  SegmentData = Segments;
+  maxSegments = nSegments;
+  ownSegmentData = false;
+  segCurrentIndex = 0;
+  segMaxDefinedIndex = -1;
+
+  //Segments past segMaxDefinedIndex are never cleared again, and properties can be set on them before
+  //they're defined, so start them all empty (no pointers, nothing to do)
+  memset(Segments, 0, nSegments * sizeof(stripSegment));
+  for (iSegment = 0; iSegment < nSegments; iSegment++) {
+    Segments[iSegment].segAction = cSegActionNone;
+    Segments[iSegment].segStep = cSegStepFinished;
+    Segments[iSegment].segSliderLEDs = 1;
+  }
+
+  //Starting noise values for each spectrum band (0..1023). Determined by experimentation. YMMV
+  //These are only seeds -- the floors are re-calibrated during silence (see SetNoiseTracking)
+  const static short nNoiseFloor[cSegNumBands] = {90, 90, 90, 100, 100, 110, 120};
+    
+  //Initialize the noise floor and max level seen for each channel and band, and the oversampling accumulators
+  for (iChannel = 0; iChannel < cSegNumChannels; iChannel++) {
+    for (iBand = 0; iBand < cSegNumBands; iBand++) {
+      noiseFloorQ8[iChannel][iBand] = ((long) nNoiseFloor[iBand]) << 8;
+      maxBandValueQ8[iChannel][iBand] = ((long) cInitialMaxBandValue) << 8;
+      samplePeak[iChannel][iBand] = 0;
+      sampleSumSq[iChannel][iBand] = 0;
+    }
+  }
+  for (iChannel = 0; iChannel < cSegNumChannelSels; iChannel++) {
+    for (iBand = 0; iBand < cSegNumBands; iBand++) {
+      SpectrumLevel[iChannel][iBand] = 0;
+      maxBandValue[iChannel][iBand] = cInitialMaxBandValue;
+    }
+  }
+  sampleCount = 0;
+  sampleLeft = true;
+  sampleRight = true;
+  defaultChannel = cSegChannelAverage;
+
+  //Default AGC & calibration behavior
+  agcAttackMS = cAGCAttackMS;
+  agcReleaseMS = cAGCReleaseMS;
+  noiseTrackMS = cNoiseTrackMS;
+  decimateMode = cSegDecimatePeak;
+  agcLastMicros = micros();
+  frameElapsedMicros = 0;
+  attackPendingMicros = 0;
+  releasePendingMicros = 0;
+  trackPendingMicros = 0;
+  spectrumSource = NULL;
+  powerSum = 0;
+  powerBudgetMA = 0;
+  ditherLevels = NULL;
+  ditherErrors = NULL;
+  ditherScale = 256;
+  layout = NULL;
+  routineBudgetMicros = 0;
+  stepSegment = 0;
+  ResetStats();
+
+  nOutputChannels = 0;
+  nLEDsInStrip = 0;
+  nSinks = 0;
+  outputMode = cOutputSequential;
+  analyzerResetStep = 0;
+  hardwareStarted = false;
+}
+
+/*_____________
+LEDSegs::Begin
+Start the analyzer reset sequence and the strips. The reset is finished by ServiceAnalyzerReset as its steps
+come due, so it overlaps clearing the strips rather than holding everything up in delays.
+*/
+
+void LEDSegs::Begin() {
+  
+  //Setup pins to drive the spectrum analyzer, and start its reset
+  pinMode(cSpectrumReset, OUTPUT);
+  pinMode(cSpectrumStrobe, OUTPUT);
+  analyzerResetStep = 0;
+  ServiceAnalyzerReset();
+  agcLastMicros = micros();
+
+  //Init this guy, which starts and clears the strips
+  hardwareStarted = true;
+  ResetStrip();
+  ServiceAnalyzerReset();
+}
+
+/*____________________________
+LEDSegs::ServiceAnalyzerReset
+Do any steps of the analyzer reset sequence that are due (strobe low, reset high, strobe high, strobe low,
+reset low, then settle). The MSGEQ7 needs well under cAnalyzerStepMicros for each. Returns true once the
+analyzer can be read.
+*/
+
+bool LEDSegs::ServiceAnalyzerReset() {
+  static const byte stepPins[cAnalyzerResetSteps - 1] = {cSpectrumStrobe, cSpectrumReset, cSpectrumStrobe, cSpectrumStrobe, cSpectrumReset};
+  static const byte stepLevels[cAnalyzerResetSteps - 1] = {LOW, HIGH, HIGH, LOW, LOW};
+
+  while (analyzerResetStep < cAnalyzerResetSteps) {
+    if ((analyzerResetStep > 0) && ((micros() - analyzerStepMicros) < cAnalyzerStepMicros)) {return false;}
+    if (analyzerResetStep < (cAnalyzerResetSteps - 1)) {digitalWrite(stepPins[analyzerResetStep], stepLevels[analyzerResetStep]);}
+    analyzerStepMicros = micros();
+    analyzerResetStep++;
+  }
+  return true;
+}
+
+/*_________________
+LEDSegs::~LEDSegs
+*/
+
+LEDSegs::~LEDSegs() {
+  short iChannel;
+
+  for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {
+    if (OutputChannels[iChannel].ownDriver) {delete OutputChannels[iChannel].objLPDStrip;}
+  }
+  if (ownSegmentData) {delete[] SegmentData;}
+}
+
+/*_______________________
+LEDSegs::AddOutputChannel
+Add a physical strip to the end of the logical strip. Pins of -1 use SPI. Returns the channel index, or -1 if
+there's no room for another.
+*/
+
+short LEDSegs::AddOutputChannel(short nLEDs, short pinData, short pinClock) {
+  short iChannel;
+
+  if (!CanAddChannel(pinData)) {return -1;}
+  iChannel = AddDriver(new LEDSegsLPD8806(nLEDs, pinData, pinClock), nLEDs, pinData, pinClock);
+  OutputChannels[iChannel].ownDriver = true;
+  return iChannel;
+}
+
+/*________________
+LEDSegs::AddDriver
+Add a physical strip with the given driver to the end of the logical strip. The driver is the caller's.
+*/
+
+short LEDSegs::AddDriver(LEDSegsDriver* Driver, short nLEDs, short pinData, short pinClock) {
+  outputChannel *chan;
+
+  if (!CanAddChannel(pinData)) {return -1;}
+  chan = &OutputChannels[nOutputChannels];
+
+  chan->objLPDStrip = Driver;
+  chan->ownDriver = false;
+  chan->firstLED = nLEDsInStrip;
+  chan->nLEDs = nLEDs;
+  chan->pinData = pinData;
+  chan->pinClock = pinClock;
+#if defined __AVR__
+  if (pinData >= 0) {
+    chan->dataPort = portOutputRegister(digitalPinToPort(pinData));
+    chan->dataMask = digitalPinToBitMask(pinData);
+    chan->clockPort = portOutputRegister(digitalPinToPort(pinClock));
+    chan->clockMask = digitalPinToBitMask(pinClock);
+  }
+#endif
+
+  //Strips added after Begin() need starting here; the others are started by ResetStrip
+  if (hardwareStarted) {
+    chan->objLPDStrip->begin();
+    chan->objLPDStrip->show();
+  }
+
+  nLEDsInStrip += nLEDs;
+  return nOutputChannels++;
+}
+
+/*______________________
+LEDSegs::CanAddChannel
+True if there's room for another output channel on pinData (-1 = SPI). Only one channel can use SPI.
+*/
+
+bool LEDSegs::CanAddChannel(short pinData) {
+  short iChannel;
+
+  if (nOutputChannels >= cMaxOutputChannels) {return false;}
+  if (pinData < 0) {
+    for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {
+      if (OutputChannels[iChannel].pinData < 0) {return false;}
+    }
+  }
+  return true;
 }
 
 /*____________________
@@ -749,10 +1926,19 @@ short LEDSegs::DefineSegment(short FirstLED, short nLEDs, short Action, uint32_t
   SetSegment_Bands(segCurrentIndex, Bands);
   
   //Segment defaults
+  SetSegment_Channel(cSegChannelDefault);
   SetSegment_BackColor(RGBOff);
   SetSegment_Spacing(0);
   SetSegment_Options(segCurrentIndex, 0);
   SetSegment_DisplayRoutine(segCurrentIndex, NULL);
+  SetSegment_StepRoutine(segCurrentIndex, NULL);
+  SegmentData[segCurrentIndex].segDoneLevel = 0;
+  SetSegment_SliderLEDs(1);
+  SetSegment_SliderSlew(0, 0);
+  SegmentData[segCurrentIndex].segSliderPos = 0;
+  SetSegment_LevelCurve(NULL);
+  SetSegment_ColorCurve(NULL);
+  SetSegment_History(segCurrentIndex, NULL);
 
   //Track the highest segment index defined. This speeds the refresh loop a bit.
   segMaxDefinedIndex = max(segMaxDefinedIndex, segCurrentIndex);
@@ -767,11 +1953,35 @@ Sample and display according to the defined segments
 */
 
 void LEDSegs::DisplaySpectrum(bool doLeft, bool doRight) { 
+  unsigned long startMicros, frameMicros;
+
+  startMicros = micros();
   ReadSpectrum(doLeft, doRight);
   MapBandsToSegments();
   ShowSegments();
+
+  frameMicros = micros() - startMicros;
+  stripStats.frames++;
+  stripStats.frameMicros = frameMicros;
+  if (frameMicros > stripStats.maxFrameMicros) {stripStats.maxFrameMicros = frameMicros;}
 };
 
+/*_________________
+LEDSegs::ResetStats
+*/
+
+void LEDSegs::ResetStats() {
+  stripStats.frames = 0;
+  stripStats.frameMicros = 0;
+  stripStats.maxFrameMicros = 0;
+  stripStats.milliAmps = 0;
+  stripStats.powerScale = 256;
+  stripStats.routineOverruns = 0;
+  stripStats.latencyMicros = 0;
+  stripStats.maxLatencyMicros = 0;
+  latencyHist.Reset();
+}
+
 /*_________________________
 LEDSegs::MapBandsToSegments
 Convert spectrum band samples into LED strip segment values in the range 0 .. (# LEDs in that segment).
@@ -779,9 +1989,12 @@ We average all the bands defined for the segment, and then scale the final segme
 */
 
 void LEDSegs::MapBandsToSegments() {
-  short iSegment, iBand, nLEDs, segBands;
+  short iSegment, iBand, nLEDs, segBands, segChannel;
+  short *levels, *maxes;
   unsigned long maxTotal, sampleTotal;
   SegmentDisplayRoutine thisDisplayRoutine;
+  stripSegment *segptr;
+  LEDSegsHistory *hist;
   
   //Loop all defined segments to calc the normalized band value. We do this even for ActionNone segments
   //in case a segment display routine wants to change the action
@@ -789,6 +2002,13 @@ void LEDSegs::MapBandsToSegments() {
     nLEDs = SegmentData[iSegment].segNumLEDs;
     segBands = SegmentData[iSegment].segBands;
 
+    //Pick the channel the segment's levels come from. No channel (nothing read) acts as silence.
+    segChannel = SegmentData[iSegment].segChannel;
+    if (segChannel == cSegChannelDefault) {segChannel = defaultChannel;}
+    if (segChannel < 0) {segBands = 0; segChannel = cSegChannelLeft;}
+    levels = SpectrumLevel[segChannel];
+    maxes = maxBandValue[segChannel];
+
     //Loop spectrum bands. For any that are mapped into this segment we total both the sample values and the
     //max possible values, in order to do the normalization.
     maxTotal = 0;
@@ -796,14 +2016,25 @@ void LEDSegs::MapBandsToSegments() {
 
     for (iBand = 0; iBand < cSegNumBands; iBand++) {
       if ((segBands >> iBand) & 1) {
-        maxTotal += maxBandValue[iBand];
-        sampleTotal += SpectrumLevel[iBand];
+        maxTotal += maxes[iBand];
+        sampleTotal += levels[iBand];
       }
     }
     if (maxTotal <= 0) {maxTotal = 1;} //Safety for use as divisor
       
-    //Normalize the averaged level to 0..1023 and record in the level array element for this segment
+    //Normalize the averaged level to 0..1023 and record in the level array element for this segment.
+    //With a slow AGC attack a sample can be above the max, so cap it.
+    if (sampleTotal > maxTotal) {sampleTotal = maxTotal;}
     sampleTotal = (sampleTotal * cMaxSegmentLevel) / maxTotal;
+    if (SegmentData[iSegment].segLevelCurve != NULL) {sampleTotal = SegmentData[iSegment].segLevelCurve[sampleTotal >> cSegCurveShift];}
+
+    //Smooth it if the segment has history
+    hist = SegmentData[iSegment].segHistory;
+    if ((hist != NULL) && (hist->smoothMS != 0)) {
+      hist->smoothQ8 += ScaleQ16((((long) sampleTotal) << 8) - hist->smoothQ8,
+        PendingCoefQ16(hist->smoothPendingMicros, frameElapsedMicros, hist->smoothMS));
+      sampleTotal = hist->smoothQ8 >> 8;
+    }
     SegmentData[iSegment].segLevel = sampleTotal;
     SegmentData[iSegment].segMaxLevel = maxTotal;
   } //end segments loop
@@ -811,45 +2042,438 @@ void LEDSegs::MapBandsToSegments() {
   //Now that all the segments are setup, call any segment display routines that are defined
   for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
     thisDisplayRoutine = SegmentData[iSegment].segDisplayRoutine;
-    if (thisDisplayRoutine != NULL) {thisDisplayRoutine(iSegment);}
+    if (thisDisplayRoutine != NULL) {thisDisplayRoutine(this, iSegment);}
   };  
-};  
+
+  //Start a new pass of each stepped routine that finished its last one, then run steps within the budget
+  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
+    segptr = &SegmentData[iSegment];
+    if ((segptr->segStepRoutine != NULL) && (segptr->segStep == cSegStepFinished)) {segptr->segStep = 0;}
+  }
+  RunSteps(micros(), routineBudgetMicros);
+
+  //Any not finished fall back to the level they last finished with, and carry on in idle time
+  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
+    segptr = &SegmentData[iSegment];
+    if ((segptr->segStepRoutine != NULL) && (segptr->segStep != cSegStepFinished)) {
+      segptr->segLevel = segptr->segDoneLevel;
+      stripStats.routineOverruns++;
+    }
+
+    //Now the level is final, update the peak and trail
+    if (segptr->segHistory != NULL) {UpdateHistory(segptr);}
+  }
+};
+
+/*______________________
+LEDSegs::UpdateHistory
+Push the peak up to the segment's level, or let it fall once it's been held long enough, and add the level
+to the trail ring
+*/
+
+void LEDSegs::UpdateHistory(stripSegment *segptr) {
+  LEDSegsHistory *hist;
+  long levelQ8, fallQ8x125;
+  unsigned long elapsedMS;
+
+  hist = segptr->segHistory;
+  levelQ8 = ((long) segptr->segLevel) << 8;
+
+  if (levelQ8 >= hist->peakQ8) {
+    hist->peakQ8 = levelQ8;
+    hist->peakMicros = agcLastMicros;
+    hist->fallPendingMicros = 0;
+  }
+  else if ((agcLastMicros - hist->peakMicros) >= (((unsigned long) hist->peakHoldMS) * 1000UL)) {
+    //Levels/sec * MS * 256 / 1000, with the time capped so it can't overflow. Time that didn't make a whole
+    //1/256 level is carried to the next display cycle, so slow falls with fast display cycles still move.
+    hist->fallPendingMicros = min(hist->fallPendingMicros + frameElapsedMicros, 1000000UL);
+    elapsedMS = hist->fallPendingMicros / 1000UL;
+    fallQ8x125 = ((long) hist->peakFall) * elapsedMS * 32L;
+    hist->peakQ8 -= fallQ8x125 / 125L;
+    hist->fallPendingMicros %= 1000UL;
+    if (hist->peakFall > 0) {hist->fallPendingMicros += ((fallQ8x125 % 125L) * 1000L) / (((long) hist->peakFall) * 32L);}
+    if (hist->peakQ8 < levelQ8) {hist->peakQ8 = levelQ8;}
+  }
+
+  if (hist->trailLevels != NULL) {
+    hist->trailNewest = (hist->trailNewest + 1) % hist->trailLength;
+    hist->trailLevels[hist->trailNewest] = segptr->segLevel;
+  }
+}
+
+/*___________________________
+LEDSegs::SetSegment_History
+Attach history storage to a segment (NULL for none), and clear it with nothing turned on
+*/
+
+void LEDSegs::SetSegment_History(short nSegment, LEDSegsHistory* History) {
+  SegmentData[nSegment].segHistory = History;
+  if (History == NULL) {return;}
+
+  History->smoothMS = 0;
+  History->smoothQ8 = 0;
+  History->smoothPendingMicros = 0;
+  History->peakColor = RGBOff;
+  History->peakHoldMS = 0;
+  History->peakFall = 0;
+  History->peakQ8 = 0;
+  History->peakMicros = 0;
+  History->fallPendingMicros = 0;
+  History->trailLevels = NULL;
+  History->trailLength = 0;
+  History->trailNewest = 0;
+  History->trailColor = RGBOff;
+}
+
+/*____________________________
+LEDSegs::SetSegment_PeakHold
+Ignored if the segment has no history attached
+*/
+
+void LEDSegs::SetSegment_PeakHold(short nSegment, uint32_t PeakColor, unsigned short HoldMS, short FallPerSec) {
+  LEDSegsHistory *hist;
+
+  hist = SegmentData[nSegment].segHistory;
+  if (hist == NULL) {return;}
+  hist->peakColor = PeakColor;
+  hist->peakHoldMS = HoldMS;
+  if (FallPerSec >= 0) {hist->peakFall = FallPerSec;}
+}
+
+/*_________________________
+LEDSegs::SetSegment_Trail
+Levels is the caller's ring of nLevels past levels. Ignored if the segment has no history attached.
+*/
+
+void LEDSegs::SetSegment_Trail(short nSegment, short Levels[], short nLevels, uint32_t TrailColor) {
+  LEDSegsHistory *hist;
+  short iLevel;
+
+  hist = SegmentData[nSegment].segHistory;
+  if (hist == NULL) {return;}
+  if ((Levels == NULL) || (nLevels <= 0)) {Levels = NULL; nLevels = 0;}
+  hist->trailLevels = Levels;
+  hist->trailLength = nLevels;
+  hist->trailNewest = 0;
+  hist->trailColor = TrailColor;
+  for (iLevel = 0; iLevel < nLevels; iLevel++) {Levels[iLevel] = 0;}
+}
+
+/*_______________
+LEDSegs::RunSteps
+Run steps of unfinished stepped display routines until they're all finished or BudgetMicros (0 = no limit)
+have passed since StartMicros. Segments take turns a step at a time, starting where the last call left off,
+so one slow routine can't keep the rest from running. Returns true if none are left unfinished.
+*/
+
+bool LEDSegs::RunSteps(unsigned long StartMicros, unsigned short BudgetMicros) {
+  short nIdle;
+  stripSegment *segptr;
+
+  //Go round the segments until a whole round finds nothing left to run
+  for (nIdle = 0; nIdle <= segMaxDefinedIndex; stepSegment++) {
+    if (stepSegment > segMaxDefinedIndex) {stepSegment = 0;}
+    segptr = &SegmentData[stepSegment];
+
+    if ((segptr->segStepRoutine == NULL) || (segptr->segStep == cSegStepFinished)) {nIdle++; continue;}
+    if ((BudgetMicros != 0) && ((micros() - StartMicros) >= BudgetMicros)) {return false;}
+    if (segptr->segStepRoutine(this, stepSegment, segptr->segStep)) {
+      segptr->segStep = cSegStepFinished;
+      segptr->segDoneLevel = segptr->segLevel;
+    }
+    else {segptr->segStep++;}
+    nIdle = 0;
+  }
+  return true;
+}
+
+/*______________________
+LEDSegs::BuildLevelCurve
+Fill a level curve with straight lines through the points (Levels[i], MapLevels[i]). Levels must be ascending.
+*/
+
+void LEDSegs::BuildLevelCurve(short Curve[], const short Levels[], const short MapLevels[], short nPoints) {
+  short iEntry, iPoint, level;
+
+  iPoint = 0;
+  for (iEntry = 0; iEntry < cSegCurveEntries; iEntry++) {
+    level = CurveEntryLevel(iEntry);
+    while ((iPoint < nPoints) && (Levels[iPoint] <= level)) {iPoint++;}
+
+    if (iPoint == 0) {Curve[iEntry] = MapLevels[0];}
+    else if (iPoint == nPoints) {Curve[iEntry] = MapLevels[nPoints - 1];}
+    else {
+      Curve[iEntry] = MapLevels[iPoint - 1] + ((((long) (MapLevels[iPoint] - MapLevels[iPoint - 1])) *
+        (level - Levels[iPoint - 1])) / (Levels[iPoint] - Levels[iPoint - 1]));
+    }
+  }
+}
+
+/*______________________
+LEDSegs::BuildGammaCurve
+Fill a level curve with level^Gamma, scaled to 0..cMaxSegmentLevel
+*/
+
+void LEDSegs::BuildGammaCurve(short Curve[], float Gamma) {
+  short iEntry;
+
+  for (iEntry = 0; iEntry < cSegCurveEntries; iEntry++) {
+    Curve[iEntry] = (short) (pow(((float) CurveEntryLevel(iEntry)) / cMaxSegmentLevel, Gamma) * cMaxSegmentLevel + 0.5);
+  }
+}
+
+/*______________________
+LEDSegs::BuildColorCurve
+Fill a color curve by blending R, G and B separately between the points (Levels[i], Colors[i]). Levels must be ascending.
+*/
+
+void LEDSegs::BuildColorCurve(uint32_t Curve[], const short Levels[], const uint32_t Colors[], short nPoints) {
+  short iEntry, iPoint, iColor, level;
+  byte lowRGB[3], highRGB[3], rgb[3];
+
+  iPoint = 0;
+  for (iEntry = 0; iEntry < cSegCurveEntries; iEntry++) {
+    level = CurveEntryLevel(iEntry);
+    while ((iPoint < nPoints) && (Levels[iPoint] <= level)) {iPoint++;}
+
+    if (iPoint == 0) {Curve[iEntry] = Colors[0];}
+    else if (iPoint == nPoints) {Curve[iEntry] = Colors[nPoints - 1];}
+    else {
+      Colorvals(Colors[iPoint - 1], lowRGB);
+      Colorvals(Colors[iPoint], highRGB);
+      for (iColor = 0; iColor < 3; iColor++) {
+        rgb[iColor] = lowRGB[iColor] + ((((long) highRGB[iColor] - lowRGB[iColor]) * (level - Levels[iPoint - 1])) /
+          (Levels[iPoint] - Levels[iPoint - 1]));
+      }
+      Curve[iEntry] = LEDSegs::Color(rgb[0], rgb[1], rgb[2]);
+    }
+  }
+}
+
+/*_____________________
+LEDSegs::SampleSpectrum
+Read one set of spectrum band samples and accumulate them for the next ReadSpectrum. Call this as often
+as you like between display cycles. Both channels are read unless no segment needs one of them.
+*/
+
+void LEDSegs::SampleSpectrum() {
+  short iBand, thisLevel;
+  bool halve;
+
+  //Nothing to read until the analyzer's reset is done
+  if ((spectrumSource == NULL) && !ServiceAnalyzerReset()) {return;}
+
+  //Timestamp a new set of samples
+  if (sampleCount == 0) {sampleSetMicros = micros();}
+
+  //When the accumulators are full, halve them so newer samples keep their weight. That's a new set, as
+  //far as latency goes, so it's timestamped again. The peaks aren't halved (see Latency).
+  halve = (sampleCount >= cMaxOversamples);
+  if (halve) {sampleCount >>= 1; sampleSetMicros = micros();}
+
+  //This loop happens nBands times per sample, so keep it quick. It just records the raw
+  //peak and sum of squares for each channel and band.
+  for(iBand=0; iBand < cSegNumBands; iBand++) {
+    if (sampleLeft) {
+      thisLevel = spectrumSource ? spectrumSource(this, cSegChannelLeft, iBand) : analogRead(cSegSpectrumAnalogLeft);
+      if (halve) {sampleSumSq[cSegChannelLeft][iBand] >>= 1;}
+      sampleSumSq[cSegChannelLeft][iBand] += ((unsigned long) thisLevel) * ((unsigned long) thisLevel);
+      if (thisLevel > samplePeak[cSegChannelLeft][iBand]) {samplePeak[cSegChannelLeft][iBand] = thisLevel;}
+    }
+    if (sampleRight) {
+      thisLevel = spectrumSource ? spectrumSource(this, cSegChannelRight, iBand) : analogRead(cSegSpectrumAnalogRight);
+      if (halve) {sampleSumSq[cSegChannelRight][iBand] >>= 1;}
+      sampleSumSq[cSegChannelRight][iBand] += ((unsigned long) thisLevel) * ((unsigned long) thisLevel);
+      if (thisLevel > samplePeak[cSegChannelRight][iBand]) {samplePeak[cSegChannelRight][iBand] = thisLevel;}
+    }
+
+    //Toggle to ready for next band
+    if (spectrumSource == NULL) {
+      digitalWrite(cSpectrumStrobe,HIGH);
+      digitalWrite(cSpectrumStrobe,LOW);     
+    }
+  }
+  sampleCount++;
+}
 
 /*___________________
 LEDSegs::ReadSpectrum
-Read the spectrum band samples into class array SpectrumLevel[].
-"Channels" tells whether to read left, right, or average both channels.
+Decimate the samples accumulated since the last call into class array SpectrumLevel[], and run the AGC and
+noise floor calibration for the time elapsed. doLeft/doRight tell which channels cSegChannelDefault segments use:
+left, right, or average of both channels.
 */
+
 void LEDSegs::ReadSpectrum(bool doLeft, bool doRight) {
-  short iBand, thisLevel, bandMax;  //Band 0 is lowest frequencies, Band 6 is the highest.
+  short iBand, iChannel, iSegment, thisLevel;  //Band 0 is lowest frequencies, Band 6 is the highest.
+  short rawLevel[cSegNumChannels][cSegNumBands];
+  unsigned long nowMicros, elapsedMicros, attackQ16, releaseQ16, trackQ16;
+  long bandMaxQ8, floorQ8;
+  bool silence, needLeft, needRight;
+
+  //Figure which channels the defined segments need
+  defaultChannel = -1;
+  if (doLeft) {defaultChannel = (doRight ? cSegChannelAverage : cSegChannelLeft);}
+  else if (doRight) {defaultChannel = cSegChannelRight;}
+
+  needLeft = false;
+  needRight = false;
+  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
+    switch (SegmentData[iSegment].segChannel) {
+      case cSegChannelLeft:  needLeft = true; break;
+      case cSegChannelRight: needRight = true; break;
+      case cSegChannelDefault: needLeft |= doLeft; needRight |= doRight; break;
+      default: needLeft = true; needRight = true; break;
+    }
+  }
 
-  //This loop happens nBands times per sample, so keep it quick. It just records the
-  //current and max sample values into the band value arrays.
-  for(iBand=0; iBand < cSegNumBands; iBand++) {
-    
-    //Decay the max a little on each sample
-    bandMax = maxBandValue[iBand] - cMaxBandValueDecay;
-    if (bandMax < cInitialMaxBandValue) bandMax = cInitialMaxBandValue;
-    
-    //Read the spectrum for this band
-    thisLevel = 0;
-    if (doLeft) {thisLevel += analogRead(cSegSpectrumAnalogLeft);}
-    if (doRight) {thisLevel += analogRead(cSegSpectrumAnalogRight);}
-    if (doLeft && doRight) {thisLevel = thisLevel >> 1;} //If both channels, then take average
-
-    //Process out assumed noise floor for this band
-    thisLevel -= nNoiseFloor[iBand];
-    if (thisLevel < 0) {thisLevel = 0;}
-
-    //Set current and max values for this into their respective segment object array slots
-    SpectrumLevel[iBand] = thisLevel;
-    if (bandMax < thisLevel) {bandMax = thisLevel;}
-    maxBandValue[iBand] = bandMax;
-    
-    //Toggle to ready for next band
-    digitalWrite(cSpectrumStrobe,HIGH);
-    digitalWrite(cSpectrumStrobe,LOW);     
+  //If that changed, the accumulated samples don't cover the right channels so start over
+  if ((needLeft != sampleLeft) || (needRight != sampleRight)) {
+    sampleLeft = needLeft;
+    sampleRight = needRight;
+    sampleCount = 0;
+    for (iChannel = 0; iChannel < cSegNumChannels; iChannel++) {
+      for (iBand = 0; iBand < cSegNumBands; iBand++) {samplePeak[iChannel][iBand] = 0; sampleSumSq[iChannel][iBand] = 0;}
+    }
+  }
+
+  //Always include at least one fresh sample, and note when the set was started for the latency
+  SampleSpectrum();
+  frameSampleMicros = (sampleCount > 0) ? sampleSetMicros : micros();
+
+  //Until the analyzer reset finishes there are no samples. Leave the levels (still clear), AGC and noise
+  //floors alone rather than decimating nothing, which would look like silence and pull the floors down.
+  if ((spectrumSource == NULL) && (analyzerResetStep < cAnalyzerResetSteps)) {
+    agcLastMicros = micros();
+    frameElapsedMicros = 0;
+    return;
+  }
+
+  //Figure the fixed point AGC/calibration coefficients for the time since we were last here
+  nowMicros = micros();
+  elapsedMicros = nowMicros - agcLastMicros;
+  agcLastMicros = nowMicros;
+  frameElapsedMicros = elapsedMicros;
+  attackQ16 = PendingCoefQ16(attackPendingMicros, elapsedMicros, agcAttackMS);
+  releaseQ16 = PendingCoefQ16(releasePendingMicros, elapsedMicros, agcReleaseMS);
+  trackQ16 = PendingCoefQ16(trackPendingMicros, elapsedMicros, noiseTrackMS);
+
+  for (iChannel = 0; iChannel < cSegNumChannels; iChannel++) {
+    //Decimate, and check for silence on this channel while we're at it
+    silence = (noiseTrackMS != 0);
+    for (iBand = 0; iBand < cSegNumBands; iBand++) {
+      if (decimateMode == cSegDecimateRMS) {thisLevel = (sampleCount > 0) ? ISqrt(sampleSumSq[iChannel][iBand] / sampleCount) : 0;}
+      else {thisLevel = samplePeak[iChannel][iBand];}
+      rawLevel[iChannel][iBand] = thisLevel;
+      if (thisLevel > ((noiseFloorQ8[iChannel][iBand] >> 8) + cNoiseSilenceMargin)) {silence = false;}
+      samplePeak[iChannel][iBand] = 0;
+      sampleSumSq[iChannel][iBand] = 0;
+    }
+
+    //A channel that wasn't read keeps its floor and AGC state, but has no level
+    if (!((iChannel == cSegChannelLeft) ? sampleLeft : sampleRight)) {
+      for (iBand = 0; iBand < cSegNumBands; iBand++) {SpectrumLevel[iChannel][iBand] = 0;}
+      continue;
+    }
+
+    for (iBand = 0; iBand < cSegNumBands; iBand++) {
+      //During silence, move the noise floor toward what we're hearing
+      floorQ8 = noiseFloorQ8[iChannel][iBand];
+      if (silence) {
+        floorQ8 += ScaleQ16((((long) rawLevel[iChannel][iBand]) << 8) - floorQ8, trackQ16);
+        floorQ8 = constrain(floorQ8, 0L, ((long) cMaxNoiseFloor) << 8);
+        noiseFloorQ8[iChannel][iBand] = floorQ8;
+      }
+
+      //Process out the noise floor for this band
+      thisLevel = rawLevel[iChannel][iBand] - (floorQ8 >> 8);
+      if (thisLevel < 0) {thisLevel = 0;}
+      SpectrumLevel[iChannel][iBand] = thisLevel;
+
+      //Attack toward a louder level, otherwise release toward the initial max
+      bandMaxQ8 = maxBandValueQ8[iChannel][iBand];
+      if ((((long) thisLevel) << 8) > bandMaxQ8) {bandMaxQ8 += ScaleQ16((((long) thisLevel) << 8) - bandMaxQ8, attackQ16);}
+      else {bandMaxQ8 -= ScaleQ16(bandMaxQ8 - (((long) cInitialMaxBandValue) << 8), releaseQ16);}
+      if (bandMaxQ8 < (((long) cInitialMaxBandValue) << 8)) {bandMaxQ8 = ((long) cInitialMaxBandValue) << 8;}
+      maxBandValueQ8[iChannel][iBand] = bandMaxQ8;
+      maxBandValue[iChannel][iBand] = bandMaxQ8 >> 8;
+    }
+  }
+  sampleCount = 0;
+
+  //Derive the average and difference selections from the two channels
+  for (iBand = 0; iBand < cSegNumBands; iBand++) {
+    SpectrumLevel[cSegChannelAverage][iBand] =
+      (SpectrumLevel[cSegChannelLeft][iBand] + SpectrumLevel[cSegChannelRight][iBand]) >> 1;
+    SpectrumLevel[cSegChannelDifference][iBand] =
+      abs(SpectrumLevel[cSegChannelLeft][iBand] - SpectrumLevel[cSegChannelRight][iBand]);
+    maxBandValue[cSegChannelAverage][iBand] =
+      (maxBandValue[cSegChannelLeft][iBand] + maxBandValue[cSegChannelRight][iBand]) >> 1;
+    maxBandValue[cSegChannelDifference][iBand] = maxBandValue[cSegChannelAverage][iBand];
+  }
+}
+
+/*__________________
+LEDSegs::TimeCoefQ16
+Return the fraction (0..65536 = 0..1.0) of the way an exponential with time constant TimeMS moves toward its
+target in ElapsedMicros. Zero TimeMS is instant.
+*/
+
+unsigned long LEDSegs::TimeCoefQ16(unsigned long ElapsedMicros, unsigned short TimeMS) {
+  unsigned long totalMicros;
+
+  if (TimeMS == 0) {return 65536UL;}
+  if (ElapsedMicros > 10000000UL) {ElapsedMicros = 10000000UL;}
+  totalMicros = (((unsigned long) TimeMS) * 1000UL) + ElapsedMicros;
+  while (ElapsedMicros >= 65536UL) {ElapsedMicros >>= 1; totalMicros >>= 1;} //Keeps the shift below in range
+  return (ElapsedMicros << 16) / totalMicros;
+}
+
+/*_____________________
+LEDSegs::PendingCoefQ16
+TimeCoefQ16 for the time in PendingMicros plus ElapsedMicros. With fast display cycles and a long time
+constant the coefficient would be too coarse (or zero, so nothing would ever move), so until it reaches
+cMinTimeCoefQ16 the time is carried forward in PendingMicros and 0 is returned.
+*/
+
+unsigned long LEDSegs::PendingCoefQ16(unsigned long &PendingMicros, unsigned long ElapsedMicros, unsigned short TimeMS) {
+  unsigned long coefQ16;
+
+  PendingMicros += ElapsedMicros;
+  coefQ16 = TimeCoefQ16(PendingMicros, TimeMS);
+  if (coefQ16 < cMinTimeCoefQ16) {return 0;}
+  PendingMicros = 0;
+  return coefQ16;
+}
+
+/*_______________
+LEDSegs::ScaleQ16
+Value * CoefQ16 / 65536, for 24.8 levels, without overflowing a long
+*/
+
+long LEDSegs::ScaleQ16(long Value, unsigned long CoefQ16) {
+  long scaled;
+
+  if (Value < 0) {return -ScaleQ16(-Value, CoefQ16);}
+  scaled = ((Value >> 8) * (long) CoefQ16) + (((Value & 0xFF) * (long) CoefQ16) >> 8);
+  return scaled >> 8;
+}
+
+/*____________
+LEDSegs::ISqrt
+Integer square root (for RMS decimation)
+*/
+
+unsigned short LEDSegs::ISqrt(unsigned long Value) {
+  unsigned long root = 0, bit = 1UL << 30;
+
+  while (bit > Value) {bit >>= 2;}
+  while (bit != 0) {
+    if (Value >= root + bit) {Value -= root + bit; root = (root >> 1) + bit;}
+    else {root >>= 1;}
+    bit >>= 2;
   }
+  return root;
 }
 
 /*_________________
@@ -860,11 +2484,12 @@ Reset the whole thing
 void LEDSegs::ResetStrip() {
   short i;
   
-  //Reset segment array
-  for (i = 0; i < cMaxSegments; i++) {SegmentData[i].segAction = cSegActionNone;}
+  //Reset the segments defined so far. The rest have never been used.
+  for (i = 0; i <= segMaxDefinedIndex; i++) {SegmentData[i].segAction = cSegActionNone;}
   
-  objLPDStrip->begin();  //Clear and init the strip
-  objLPDStrip->show();  //Update the LED strip display to show off to start
+  //Clear and init the strips, and update them to show off to start
+  for (i = 0; i < nOutputChannels; i++) {OutputChannels[i].objLPDStrip->begin();}
+  ShowOutputChannels();
   segCurrentIndex = 0;
   segMaxDefinedIndex = -1;
 
@@ -893,15 +2518,17 @@ Display the segment values on the LED strip
 */
 
 void LEDSegs::ShowSegments() {
-  short    iSegment, iLEDinSegment, iLED, LEDIncrement, segval, ledval;
-  short    FirstLED, NumberLEDs, Action, Options, segSpacing1, SpacingCount;
-  bool     optOffOverwrite, optModulate, notSpacingLED, doled;
+  short    iSegment, iLEDinSegment, iLED, LEDIncrement, segval, ledval, iSink;
+  short    FirstLED, NumberLEDs, Action, Options, segSpacing1, SpacingCount, iColor, level;
+  unsigned long latency;
+  bool     optOffOverwrite, optModulate, notSpacingLED, doled, hiResFore;
+  unsigned short fcQ8[3];
   uint32_t thisColor, backColor, foreColor;
   byte     bcRGB[3], fcRGB[3]; //extra byte for long align
   stripSegment *segptr;
 
   //First, init all LEDs in the strip to off
-  for (iLED = 0; iLED < nLEDsInStrip; iLED++) {objLPDStrip->setPixelColor(iLED, RGBOff);}
+  FillPhysical(0, nLEDsInStrip, RGBOff);
   
   //Write each defined segment
   for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
@@ -925,12 +2552,15 @@ void LEDSegs::ShowSegments() {
       optModulate = (Options & cSegOptModulateSegment) != 0;
       
       //The level coming out of MapBandsToSegments() is normalized to 0..1023. Here we
-      //scale to the number of LEDs that means for this segment.
+      //scale to the number of LEDs that means for this segment. It's inverted into a local rather than
+      //in segLevel, which stepped display routines may still be working from.
       
-      if (Options & cSegOptInvertLevel) {segptr->segLevel = cMaxSegmentLevel - segptr->segLevel;}
-      segval = segptr->segLevel;
-      segval = (((long) segval) * ((long) (NumberLEDs + 1))) / ((long) (cMaxSegmentLevel + 1));
-      segval = constrain(segval, 0, NumberLEDs); //Insure within expected range
+      level = segptr->segLevel;
+      if (Options & cSegOptInvertLevel) {level = cMaxSegmentLevel - level;}
+      if (segptr->segColorCurve != NULL) {
+        foreColor = segptr->segColorCurve[constrain(level, 0, cMaxSegmentLevel) >> cSegCurveShift];
+      }
+      segval = LevelToLEDs(level, NumberLEDs);
       ledval = segval;
       if ((Action == cSegActionStatic) || (Action == cSegActionRandom)) {ledval = NumberLEDs;}
 
@@ -944,6 +2574,29 @@ void LEDSegs::ShowSegments() {
           , bcRGB[1] + (((fcRGB[1] - bcRGB[1]) * segval) / NumberLEDs)
           , bcRGB[2] + (((fcRGB[2] - bcRGB[2]) * segval) / NumberLEDs));
       }
+
+      //When dithering, modulate from the full level to 1/256th of a color step instead
+      hiResFore = optModulate && (ditherLevels != NULL);
+      if (hiResFore) {
+        for (iColor = 0; iColor < 3; iColor++) {
+          fcQ8[iColor] = (((short) bcRGB[iColor]) << 8) + ((((long) fcRGB[iColor] - bcRGB[iColor]) << 8) *
+            constrain(level, 0, cMaxSegmentLevel)) / cMaxSegmentLevel;
+        }
+      }
+
+      //Sliders are just a couple of spans, no need for the per-LED loop
+      if (Action == cSegActionSlider) {
+        ShowSlider(segptr, level, foreColor, optOffOverwrite);
+        continue;
+      }
+
+      //Without spacing or per-LED decisions, the fill actions are just a foreground and a background span
+      if ((segSpacing1 == 1) && (Action != cSegActionRandom) && !hiResFore) {
+        if ((foreColor != RGBOff) || optOffOverwrite) {FillLevelSpan(segptr, 0, ledval, foreColor);}
+        if ((backColor != RGBOff) || optOffOverwrite) {FillLevelSpan(segptr, ledval, NumberLEDs, backColor);}
+        if (segptr->segHistory != NULL) {ShowHistory(segptr, level, (Options & cSegOptInvertLevel) != 0);}
+        continue;
+      }
   
       //Get the starting LED index for this segment and an initial increment to get to the next LED
       switch (Action) {
@@ -980,10 +2633,13 @@ void LEDSegs::ShowSegments() {
         
         doled = (notSpacingLED & ((thisColor != RGBOff) | optOffOverwrite));
         if (doled & (Action == cSegActionRandom)) {
-          if (segRandomLevels[iLEDinSegment & 0x3F] > segptr->segLevel) {doled = false;}
+          if (segRandomLevels[iLEDinSegment & 0x3F] > level) {doled = false;}
         }
 
-        if (doled) {objLPDStrip->setPixelColor(iLED, thisColor);}
+        if (doled) {
+          if (hiResFore && (ledval > iLEDinSegment)) {SetLEDQ8(iLED, fcQ8);}
+          else {SetLED(iLED, thisColor);}
+        }
    
         //Move to next LED. For from-middle, we jump back and forth around the center of the segment, increasing
         //the increment's absolute value by one more each jump.
@@ -1004,11 +2660,969 @@ void LEDSegs::ShowSegments() {
 
         iLED += LEDIncrement;
       } //LED-in-segment loop
+
+      //Trail and peak dot past the end of the fill
+      if (segptr->segHistory != NULL) {ShowHistory(segptr, level, (Options & cSegOptInvertLevel) != 0);}
     } //If an action defined
   }  //Segment loop
 
-  //Finally, refresh the strip.
-  objLPDStrip->show();
+  //Finally, keep within the power budget, refresh the strip, and pass the frame on to any sinks
+  LimitPower();
+  if (ditherLevels != NULL) {DitherStep();}
+  ShowOutputChannels();
+
+  latency = micros() - frameSampleMicros;
+  stripStats.latencyMicros = latency;
+  if (latency > stripStats.maxLatencyMicros) {stripStats.maxLatencyMicros = latency;}
+  latencyHist.Add(latency);
+
+  for (iSink = 0; iSink < nSinks; iSink++) {Sinks[iSink]->FrameShown(this);}
+}
+
+/*_________________
+LEDSegs::ShowSlider
+Move a cSegActionSlider segment's slider toward the position for Level, within its slew limits, and
+write it to the strip as a foreground span with background spans on either side.
+*/
+
+void LEDSegs::ShowSlider(stripSegment *segptr, short Level, uint32_t foreColor, bool optOffOverwrite) {
+  short sliderLEDs, travel, startLED, endLED, lastLED;
+  long pos, target;  //In 1/16 LEDs, which can be past a short's range on long strips
+  uint32_t backColor;
+
+  sliderLEDs = constrain(segptr->segSliderLEDs, 0, segptr->segNumLEDs);
+  travel = segptr->segNumLEDs - sliderLEDs;
+
+  //Target offset for the level, then limit the move from where we were
+  target = (((long) constrain(Level, 0, cMaxSegmentLevel)) * ((long) travel) * cSegSliderOneLED) / cMaxSegmentLevel;
+  pos = constrain(segptr->segSliderPos, 0L, ((long) travel) * cSegSliderOneLED);
+  if ((segptr->segSliderAttack > 0) && (target > (pos + segptr->segSliderAttack))) {target = pos + segptr->segSliderAttack;}
+  if ((segptr->segSliderDecay > 0) && (target < (pos - segptr->segSliderDecay))) {target = pos - segptr->segSliderDecay;}
+  segptr->segSliderPos = target;
+
+  //Round to the nearest LED
+  startLED = segptr->segFirstLED + ((target + (cSegSliderOneLED >> 1)) / cSegSliderOneLED);
+  endLED = startLED + sliderLEDs;
+  lastLED = segptr->segFirstLED + segptr->segNumLEDs;
+
+  backColor = segptr->segBackColor;
+  if ((backColor != RGBOff) || optOffOverwrite) {
+    FillSpan(segptr->segFirstLED, startLED - segptr->segFirstLED, backColor);
+    FillSpan(endLED, lastLED - endLED, backColor);
+  }
+  if ((foreColor != RGBOff) || optOffOverwrite) {FillSpan(startLED, sliderLEDs, foreColor);}
+}
+
+/*____________________
+LEDSegs::ShowHistory
+Draw a fill segment's trail, oldest first so newer levels are drawn over them, each a span from the end of the
+fill out to that level in the trail color dimmed by age. Then the peak dot. Invert is the segment's
+cSegOptInvertLevel, already applied to Level but not to the history.
+*/
+
+void LEDSegs::ShowHistory(stripSegment *segptr, short Level, bool Invert) {
+  LEDSegsHistory *hist;
+  short nLEDs, fillLEDs, levelLEDs, age, level, iColor;
+  byte trailRGB[3], ageRGB[3];
+  uint32_t peakColor;
+
+  hist = segptr->segHistory;
+  nLEDs = segptr->segNumLEDs;
+  if ((segptr->segAction != cSegActionFromBottom) && (segptr->segAction != cSegActionFromTop) &&
+      (segptr->segAction != cSegActionFromMiddle)) {return;}
+  fillLEDs = LevelToLEDs(Level, nLEDs);
+
+  if (hist->trailLevels != NULL) {
+    Colorvals(hist->trailColor, trailRGB);
+    for (age = hist->trailLength - 1; age > 0; age--) {
+      level = hist->trailLevels[(hist->trailNewest + hist->trailLength - age) % hist->trailLength];
+      if (Invert) {level = cMaxSegmentLevel - level;}
+      levelLEDs = LevelToLEDs(level, nLEDs);
+      if (levelLEDs <= fillLEDs) {continue;}
+      for (iColor = 0; iColor < 3; iColor++) {
+        ageRGB[iColor] = (((short) trailRGB[iColor]) * (hist->trailLength - age)) / hist->trailLength;
+      }
+      FillLevelSpan(segptr, fillLEDs, levelLEDs, LEDSegs::Color(ageRGB[0], ageRGB[1], ageRGB[2]));
+    }
+  }
+
+  peakColor = hist->peakColor;
+  if (peakColor != RGBOff) {
+    level = hist->peakQ8 >> 8;
+    if (Invert) {level = cMaxSegmentLevel - level;}
+    levelLEDs = LevelToLEDs(level, nLEDs);
+    if (levelLEDs > 0) {
+      FillLevelSpan(segptr, max(levelLEDs - ((segptr->segAction == cSegActionFromMiddle) ? 2 : 1), 0), levelLEDs, peakColor);
+    }
+  }
+}
+
+/*______________________
+LEDSegs::FillLevelSpan
+Fill the LEDs a fill (or static) segment lights at ToLEDs but not at FromLEDs. FromMiddle segments light the
+middle LED, then alternately above and below it, so that's a span on each side.
+*/
+
+void LEDSegs::FillLevelSpan(stripSegment *segptr, short FromLEDs, short ToLEDs, uint32_t Color) {
+  short firstLED, middleLED, fromUp, toUp, fromDown, toDown;
+
+  firstLED = segptr->segFirstLED;
+  switch (segptr->segAction) {
+    case cSegActionStatic:
+    case cSegActionFromBottom: FillSpan(firstLED + FromLEDs, ToLEDs - FromLEDs, Color); break;
+    case cSegActionFromTop:    FillSpan(firstLED + segptr->segNumLEDs - ToLEDs, ToLEDs - FromLEDs, Color); break;
+    case cSegActionFromMiddle:
+      //# lit from the middle up (including it) and below it
+      middleLED = firstLED + ((segptr->segNumLEDs - 1) >> 1);
+      fromUp = (FromLEDs > 0) ? ((FromLEDs >> 1) + 1) : 0;
+      fromDown = (FromLEDs > 0) ? ((FromLEDs - 1) >> 1) : 0;
+      toUp = (ToLEDs > 0) ? ((ToLEDs >> 1) + 1) : 0;
+      toDown = (ToLEDs > 0) ? ((ToLEDs - 1) >> 1) : 0;
+      FillSpan(middleLED + fromUp, toUp - fromUp, Color);
+      FillSpan(middleLED - toDown, toDown - fromDown, Color);
+      break;
+  }
+}
+
+/*_______________
+LEDSegs::FillSpan
+Set a run of LEDs to one color. With a layout, these are logical LEDs, filled a physical span at a time.
+*/
+
+void LEDSegs::FillSpan(short FirstLED, short nLEDs, uint32_t Color) {
+  short iSpan, endLED, spanEnd, first, n;
+  LEDSegsLayoutSpan *span;
+
+  if (layout == NULL) {FillPhysical(FirstLED, nLEDs, Color); return;}
+
+  FirstLED = max(FirstLED, (short) 0);
+  endLED = min((short) (FirstLED + nLEDs), layout->nLogical);
+  for (iSpan = layout->FindSpan(FirstLED); (iSpan >= 0) && (iSpan < layout->nSpans); iSpan++) {
+    span = &layout->spans[iSpan];
+    if (span->logicalFirst >= endLED) {break;}
+    if (span->physicalFirst < 0) {continue;}
+
+    //The part of the span in the run, as an offset from its start and a count
+    first = max(FirstLED, span->logicalFirst) - span->logicalFirst;
+    spanEnd = span->logicalFirst + abs(span->nLEDs);
+    n = min(endLED, spanEnd) - span->logicalFirst - first;
+    if (span->nLEDs > 0) {FillPhysical(span->physicalFirst + first, n, Color);}
+    else {FillPhysical(span->physicalFirst - first - n + 1, n, Color);}
+  }
+}
+
+/*___________________
+LEDSegs::FillPhysical
+Set nLEDs consecutive physical LEDs, starting at FirstLED, to one color. The span is split by
+output channel so there's no per-LED channel lookup.
+*/
+
+void LEDSegs::FillPhysical(short FirstLED, short nLEDs, uint32_t Color) {
+  short iChannel, iLED, startLED, endLED, weight;
+  outputChannel *chan;
+
+  weight = ColorWeight(Color);
+  for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {
+    chan = &OutputChannels[iChannel];
+    startLED = max(FirstLED, chan->firstLED);
+    endLED = min(FirstLED + nLEDs, chan->firstLED + chan->nLEDs);
+    for (iLED = startLED - chan->firstLED; iLED < endLED - chan->firstLED; iLED++) {
+      powerSum += weight - ColorWeight(chan->objLPDStrip->getPixelColor(iLED));
+      chan->objLPDStrip->setPixelColor(iLED, Color);
+    }
+  }
+
+  if (ditherLevels != NULL) {
+    startLED = max(FirstLED, 0);
+    endLED = min(FirstLED + nLEDs, nLEDsInStrip);
+    for (iLED = startLED; iLED < endLED; iLED++) {
+      ditherLevels[(3 * iLED)] = (Color >> 0) & 0x7F00;
+      ditherLevels[(3 * iLED) + 1] = (Color >> 8) & 0x7F00;
+      ditherLevels[(3 * iLED) + 2] = (Color << 8) & 0x7F00;
+    }
+  }
+}
+
+/*_____________
+LEDSegs::SetLED
+Set one LED to a color, looking it up in the layout if there is one
+*/
+
+void LEDSegs::SetLED(short iLED, uint32_t Color) {
+  if (layout != NULL) {iLED = layout->GetPhysical(iLED);}
+  SetPhysicalLED(iLED, Color);
+}
+
+/*_____________________
+LEDSegs::SetPhysicalLED
+Set one LED in the logical strip to a color. Out of range LEDs are ignored.
+*/
+
+void LEDSegs::SetPhysicalLED(short iLED, uint32_t Color) {
+  outputChannel *chan, *lastChan;
+
+  chan = OutputChannels;
+  lastChan = &OutputChannels[nOutputChannels - 1];
+  while ((chan < lastChan) && (iLED >= (chan->firstLED + chan->nLEDs))) {chan++;}
+  iLED -= chan->firstLED;
+  if ((iLED >= 0) && (iLED < chan->nLEDs)) {
+    powerSum += ColorWeight(Color) - ColorWeight(chan->objLPDStrip->getPixelColor(iLED));
+    chan->objLPDStrip->setPixelColor(iLED, Color);
+
+    if (ditherLevels != NULL) {
+      iLED = 3 * (iLED + chan->firstLED);
+      ditherLevels[iLED] = (Color >> 0) & 0x7F00;
+      ditherLevels[iLED + 1] = (Color >> 8) & 0x7F00;
+      ditherLevels[iLED + 2] = (Color << 8) & 0x7F00;
+    }
+  }
+}
+
+/*_______________
+LEDSegs::SetLEDQ8
+Set one LED from R,G,B values in 7.8 fixed point (dithering only). The strip itself gets the rounded
+down color until the next DitherStep.
+*/
+
+void LEDSegs::SetLEDQ8(short iLED, unsigned short RGBQ8[]) {
+  if (layout != NULL) {iLED = layout->GetPhysical(iLED);}
+  SetPhysicalLED(iLED, LEDSegs::Color(RGBQ8[0] >> 8, RGBQ8[1] >> 8, RGBQ8[2] >> 8));
+  if ((iLED >= 0) && (iLED < nLEDsInStrip)) {
+    ditherLevels[3 * iLED] = RGBQ8[0];
+    ditherLevels[(3 * iLED) + 1] = RGBQ8[1];
+    ditherLevels[(3 * iLED) + 2] = RGBQ8[2];
+  }
+}
+
+/*___________________
+LEDSegs::SetDithering
+Turn on dithering with the caller's per-LED memory (3 * LEDs of each), or off with NULLs
+*/
+
+void LEDSegs::SetDithering(unsigned short Levels[], byte Errors[]) {
+  short i, iLED;
+  uint32_t color;
+
+  ditherLevels = NULL;
+  ditherErrors = NULL;
+  if ((Levels == NULL) || (Errors == NULL)) {return;}
+
+  //Start from what's on the strip now
+  for (iLED = 0, i = 0; iLED < nLEDsInStrip; iLED++, i += 3) {
+    color = GetLEDColor(iLED);
+    Levels[i] = (color >> 0) & 0x7F00;
+    Levels[i + 1] = (color >> 8) & 0x7F00;
+    Levels[i + 2] = (color << 8) & 0x7F00;
+    Errors[i] = Errors[i + 1] = Errors[i + 2] = 0;
+  }
+  ditherLevels = Levels;
+  ditherErrors = Errors;
+}
+
+/*____________________
+LEDSegs::RefreshDither
+Re-send the strip with the next dither step. Call between display cycles as often as possible.
+*/
+
+void LEDSegs::RefreshDither() {
+  if (ditherLevels == NULL) {return;}
+  DitherStep();
+  ShowOutputChannels();
+}
+
+/*_________________
+LEDSegs::DitherStep
+Round each LED's 7.8 fixed point color (scaled by the power limiter) to 7 bits for the strip, carrying
+the rounding error to the next step. This runs at the refresh rate, so it walks each physical strip's
+LEDs straight through with pointers and no per-LED lookups.
+*/
+
+void LEDSegs::DitherStep() {
+  short iChannel, iLED;
+  unsigned short value, r, g, b;
+  unsigned short *level;
+  byte *error;
+  outputChannel *chan;
+  uint32_t oldColor, newColor;
+
+  level = ditherLevels;
+  error = ditherErrors;
+  for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {
+    chan = &OutputChannels[iChannel];
+    for (iLED = 0; iLED < chan->nLEDs; iLED++) {
+      value = ((((unsigned long) *level++) * ditherScale) >> 8) + *error; r = value >> 8; *error++ = value;
+      value = ((((unsigned long) *level++) * ditherScale) >> 8) + *error; g = value >> 8; *error++ = value;
+      value = ((((unsigned long) *level++) * ditherScale) >> 8) + *error; b = value >> 8; *error++ = value;
+
+      newColor = LEDSegs::Color(r, g, b);
+      oldColor = chan->objLPDStrip->getPixelColor(iLED);
+      if (newColor != oldColor) {
+        powerSum += ColorWeight(newColor) - ColorWeight(oldColor);
+        chan->objLPDStrip->setPixelColor(iLED, newColor);
+      }
+    }
+  }
+}
+
+/*_________________
+LEDSegs::LimitPower
+Record the frame's estimated current, and if it's over the power budget dim every LED by the same
+fixed point scale to fit. Only an over-budget frame costs a pass over the strip.
+*/
+
+void LEDSegs::LimitPower() {
+  short iChannel, iLED, scale;
+  unsigned long milliAmps;
+  uint32_t color;
+  outputChannel *chan;
+
+  milliAmps = (powerSum * cPowerMAPerChannel) / 127;
+  stripStats.milliAmps = milliAmps;
+  stripStats.powerScale = 256;
+  ditherScale = 256;
+  if ((powerBudgetMA == 0) || (milliAmps <= powerBudgetMA)) {return;}
+
+  scale = (powerBudgetMA << 8) / milliAmps;
+  stripStats.powerScale = scale;
+
+  //When dithering, the scale is applied as the dithered colors are sent
+  if (ditherLevels != NULL) {ditherScale = scale; return;}
+
+  powerSum = 0;
+  for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {
+    chan = &OutputChannels[iChannel];
+    for (iLED = 0; iLED < chan->nLEDs; iLED++) {
+      color = chan->objLPDStrip->getPixelColor(iLED);
+      if (color == RGBOff) {continue;}
+      color = LEDSegs::Color(
+          (((color >> 8) & 0x7F) * scale) >> 8
+        , (((color >> 16) & 0x7F) * scale) >> 8
+        , ((color & 0x7F) * scale) >> 8);
+      powerSum += ColorWeight(color);
+      chan->objLPDStrip->setPixelColor(iLED, color);
+    }
+  }
+}
+
+/*__________________
+LEDSegs::GetLEDColor
+Get the color of one LED in the logical strip as last set. Out of range LEDs are RGBOff.
+*/
+
+uint32_t LEDSegs::GetLEDColor(short iLED) {
+  outputChannel *chan, *lastChan;
+
+  chan = OutputChannels;
+  lastChan = &OutputChannels[nOutputChannels - 1];
+  while ((chan < lastChan) && (iLED >= (chan->firstLED + chan->nLEDs))) {chan++;}
+  iLED -= chan->firstLED;
+  if ((iLED < 0) || (iLED >= chan->nLEDs)) {return RGBOff;}
+  return chan->objLPDStrip->getPixelColor(iLED);
+}
+
+/*______________
+LEDSegs::AddSink
+Add a sink to be passed each frame shown. Returns false if there's no room for another.
+*/
+
+bool LEDSegs::AddSink(LEDSegsSink* Sink) {
+  if (nSinks >= cMaxSinks) {return false;}
+  Sinks[nSinks++] = Sink;
+  return true;
+}
+
+/*_________________________
+LEDSegs::ShowOutputChannels
+Send the LED colors out to all the physical strips
+*/
+
+void LEDSegs::ShowOutputChannels() {
+  short iChannel;
+
+  if ((outputMode == cOutputParallel) && (nOutputChannels > 1)) {ShowParallel(); return;}
+  for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {OutputChannels[iChannel].objLPDStrip->show();}
+}
+
+/*___________________
+LEDSegs::ShowParallel
+Update all the digital-pin strips at once. Each data bit is set on every strip's data pin, then all the
+clocks are pulsed together, so the time is that of the longest strip. An SPI strip is updated on its own
+first. Strips shorter than the longest just see a longer run of zero "latch" bytes at the end.
+*/
+
+void LEDSegs::ShowParallel() {
+  short iChannel, maxLEDs, iLED, nLatch, iByte;
+  byte chanBytes[cMaxOutputChannels];
+  uint32_t pixels[cMaxOutputChannels];
+  outputChannel *chan;
+
+  maxLEDs = 0;
+  for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {
+    chan = &OutputChannels[iChannel];
+    if (chan->pinData < 0) {chan->objLPDStrip->show();}
+    else {maxLEDs = max(maxLEDs, chan->nLEDs);}
+  }
+
+  //LPD8806 data is G, R, B per LED, each with the high bit set
+  for (iLED = 0; iLED < maxLEDs; iLED++) {
+    for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {
+      chan = &OutputChannels[iChannel];
+      pixels[iChannel] = (iLED < chan->nLEDs) ? (chan->objLPDStrip->getPixelColor(iLED) | 0x808080UL) : 0;
+    }
+    for (iByte = 16; iByte >= 0; iByte -= 8) {
+      for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {chanBytes[iChannel] = pixels[iChannel] >> iByte;}
+      WriteParallel(chanBytes, 8);
+    }
+  }
+
+  //Then the zero bytes that latch the data into the strips
+  for (iChannel = 0; iChannel < nOutputChannels; iChannel++) {chanBytes[iChannel] = 0;}
+  nLatch = (maxLEDs + 31) / 32;
+  for (iByte = 0; iByte < nLatch; iByte++) {WriteParallel(chanBytes, 8);}
+}
+
+/*____________________
+LEDSegs::WriteParallel
+Clock out the high nBits of one byte per channel to all the digital-pin strips, MSB first
+*/
+
+void LEDSegs::WriteParallel(byte chanBytes[], short nBits) {
+  byte bit, *chanByte;
+  outputChannel *chan, *endChan;
+
+  endChan = &OutputChannels[nOutputChannels];
+  for (bit = 0x80; nBits > 0; bit >>= 1, nBits--) {
+    for (chan = OutputChannels, chanByte = chanBytes; chan < endChan; chan++, chanByte++) {
+      if (chan->pinData < 0) {continue;}
+#if defined __AVR__
+      if (*chanByte & bit) {*chan->dataPort |= chan->dataMask;} else {*chan->dataPort &= ~chan->dataMask;}
+      *chan->clockPort |= chan->clockMask;
+#else
+      digitalWrite(chan->pinData, (*chanByte & bit) ? HIGH : LOW);
+      digitalWrite(chan->pinClock, HIGH);
+#endif
+    }
+    for (chan = OutputChannels; chan < endChan; chan++) {
+      if (chan->pinData < 0) {continue;}
+#if defined __AVR__
+      *chan->clockPort &= ~chan->clockMask;
+#else
+      digitalWrite(chan->pinClock, LOW);
+#endif
+    }
+  }
+}
+/*__________________________________________
+LEDSegsBufferLPD8806::LEDSegsBufferLPD8806
+*/
+
+LEDSegsBufferLPD8806::LEDSegsBufferLPD8806(byte Pixels[], short nLEDs, short pinData, short pinClock) {
+  pixels = Pixels;
+  numLEDs = nLEDs;
+  dataPin = pinData;
+  clockPin = pinClock;
+  memset(pixels, 0, 3 * nLEDs);
+}
+
+/*___________________________
+LEDSegsBufferLPD8806::begin
+Set up SPI or the pins, and latch the strip so it's ready for data
+*/
+
+void LEDSegsBufferLPD8806::begin() {
+  if (dataPin < 0) {
+    SPI.begin();
+    SPI.setBitOrder(MSBFIRST);
+    SPI.setDataMode(SPI_MODE0);
+#if defined __SAM3X8E__
+    SPI.setClockDivider(21);  //4MHz, as with the Due tweak to the LPD8806 library
+#else
+    SPI.setClockDivider(SPI_CLOCK_DIV8);
+#endif
+  }
+  else {
+    pinMode(dataPin, OUTPUT);
+    pinMode(clockPin, OUTPUT);
+    digitalWrite(clockPin, LOW);
+#if defined __AVR__
+    dataPort = portOutputRegister(digitalPinToPort(dataPin));
+    dataMask = digitalPinToBitMask(dataPin);
+    clockPort = portOutputRegister(digitalPinToPort(clockPin));
+    clockMask = digitalPinToBitMask(clockPin);
+#endif
+  }
+  WriteLatch();
+}
+
+/*__________________________
+LEDSegsBufferLPD8806::show
+Send the buffer to the strip, G, R, B per LED each with the high bit set, then the latch
+*/
+
+void LEDSegsBufferLPD8806::show() {
+  byte *pixel, *endPixel;
+
+  endPixel = &pixels[3 * numLEDs];
+  for (pixel = pixels; pixel < endPixel; pixel++) {WriteByte(*pixel | 0x80);}
+  WriteLatch();
+}
+
+/*________________________________
+LEDSegsBufferLPD8806::WriteLatch
+The zero bytes that latch the data into the strip
+*/
+
+void LEDSegsBufferLPD8806::WriteLatch() {
+  short iByte;
+
+  for (iByte = (numLEDs + 31) / 32; iByte > 0; iByte--) {WriteByte(0);}
+}
+
+/*_______________________________
+LEDSegsBufferLPD8806::WriteByte
+*/
+
+void LEDSegsBufferLPD8806::WriteByte(byte Value) {
+  byte bit;
+
+  if (dataPin < 0) {SPI.transfer(Value); return;}
+  for (bit = 0x80; bit != 0; bit >>= 1) {
+#if defined __AVR__
+    if (Value & bit) {*dataPort |= dataMask;} else {*dataPort &= ~dataMask;}
+    *clockPort |= clockMask;
+    *clockPort &= ~clockMask;
+#else
+    digitalWrite(dataPin, (Value & bit) ? HIGH : LOW);
+    digitalWrite(clockPin, HIGH);
+    digitalWrite(clockPin, LOW);
+#endif
+  }
+}
+
+/*__________________________
+LEDSegsScheduler::AddStrip
+Add a strip to run every PeriodMS with DisplaySpectrum(doLeft, doRight). Returns its index, or -1 if full.
+*/
+
+short LEDSegsScheduler::AddStrip(LEDSegs* strip, unsigned short PeriodMS, bool doLeft, bool doRight) {
+  scheduledStrip *entry;
+
+  if (nStrips >= cMaxScheduledStrips) {return -1;}
+  entry = &Strips[nStrips];
+  entry->strip = strip;
+  entry->periodMicros = ((unsigned long) PeriodMS) * 1000UL;
+  entry->dueMicros = micros();
+  entry->deadlineMisses = 0;
+  entry->doLeft = doLeft;
+  entry->doRight = doRight;
+  return nStrips++;
+}
+
+/*_____________________
+LEDSegsScheduler::Run
+Do the display cycle for the most overdue strip, or if none is due, oversample for the one due next.
+Call this continuously from loop().
+*/
+
+void LEDSegsScheduler::Run() {
+  short iStrip, iNext;
+  long untilDue, nextUntilDue;
+  unsigned long nowMicros;
+  scheduledStrip *entry;
+
+  if (nStrips == 0) {return;}
+
+  //Find the strip due soonest (or most overdue). Signed differences handle micros() wrapping.
+  nowMicros = micros();
+  iNext = 0;
+  nextUntilDue = (long) (Strips[0].dueMicros - nowMicros);
+  for (iStrip = 1; iStrip < nStrips; iStrip++) {
+    untilDue = (long) (Strips[iStrip].dueMicros - nowMicros);
+    if (untilDue < nextUntilDue) {nextUntilDue = untilDue; iNext = iStrip;}
+  }
+  entry = &Strips[iNext];
+
+  //Nothing due: finish any stepped display routine work for the next strip, then oversample for it
+  if (nextUntilDue > 0) {
+    entry->strip->RunDeferredSteps(min(nextUntilDue, (long) cSchedulerStepMicros));
+    entry->strip->SampleSpectrum();
+    return;
+  }
+
+  //A whole period late is a missed frame. Catch up rather than trying to make up the lost cycles.
+  if (-nextUntilDue >= (long) entry->periodMicros) {
+    entry->deadlineMisses++;
+    entry->dueMicros = nowMicros;
+  }
+  entry->dueMicros += entry->periodMicros;
+
+  entry->strip->DisplaySpectrum(entry->doLeft, entry->doRight);
+  busyMicros += micros() - nowMicros;
+
+  //Keep the load window short of the 71 minute micros() wrap: halve it, which keeps the ratio
+  if ((nowMicros - statsStartMicros) >= cSchedulerStatsWindowMicros) {
+    busyMicros >>= 1;
+    statsStartMicros += (nowMicros - statsStartMicros) >> 1;
+  }
+}
+
+/*_________________________________
+LEDSegsScheduler::GetLoadPercent
+Percent of the time since ResetStats spent in display cycles. After cSchedulerStatsWindowMicros the older
+half of the window is dropped, so a long run reports the recent load rather than wrapping.
+*/
+
+short LEDSegsScheduler::GetLoadPercent() {
+  unsigned long elapsedMicros;
+
+  elapsedMicros = micros() - statsStartMicros;
+  if (elapsedMicros == 0) {return 0;}
+  return (busyMicros / 10UL) / ((elapsedMicros / 1000UL) + 1);
+}
+
+/*_____________________________
+LEDSegsScheduler::ResetStats
+*/
+
+void LEDSegsScheduler::ResetStats() {
+  short iStrip;
+
+  statsStartMicros = micros();
+  busyMicros = 0;
+  for (iStrip = 0; iStrip < nStrips; iStrip++) {Strips[iStrip].deadlineMisses = 0;}
+}
+/*_________________________________
+LEDSegsFrameRing::LEDSegsFrameRing
+Buffer must have LEDSegsFrameRingLongs(nSlots, nLEDs) elements.
+*/
+
+LEDSegsFrameRing::LEDSegsFrameRing(unsigned long Buffer[], short nSlots, short nLEDs) {
+  short iSlot;
+
+  ringBuffer = Buffer;
+  ringSlots = nSlots;
+  ringLEDs = nLEDs;
+  slotLongs = LEDSegsFrameRingSlotLongs(nLEDs);
+  ringFrames = 0;
+  publishMicros = 0;
+  for (iSlot = 0; iSlot < nSlots; iSlot++) {*SlotSeq(iSlot) = 0;}
+}
+
+/*_________________________
+LEDSegsFrameRing::ReadLong
+Read a long the other side may be writing. On 8-bit boards that takes several instructions, so an interrupt
+can change it part way; read until two reads agree, rather than locking the writer out.
+*/
+
+unsigned long LEDSegsFrameRing::ReadLong(volatile unsigned long *Value) {
+  unsigned long value;
+
+  do {value = *Value;} while (value != *Value);
+  return value;
+}
+
+/*___________________________
+LEDSegsFrameRing::FrameShown
+Copy the frame into the next slot. The slot's sequence number is 2n-1 (odd) while frame n is being written
+and 2n once it's complete.
+*/
+
+void LEDSegsFrameRing::FrameShown(LEDSegs* strip) {
+  short iLED, nLEDs, iSlot;
+  unsigned long startMicros, frame;
+  uint32_t color;
+  volatile byte *data;
+
+  startMicros = micros();
+  frame = ringFrames + 1;
+  iSlot = (frame - 1) % ringSlots;
+  data = SlotData(iSlot);
+  nLEDs = min(ringLEDs, strip->GetNumLEDs());
+
+  *SlotSeq(iSlot) = (2 * frame) - 1;
+  for (iLED = 0; iLED < nLEDs; iLED++) {
+    color = strip->GetLEDColor(iLED);
+    *data++ = (color >> 8) & 0x7F;
+    *data++ = (color >> 16) & 0x7F;
+    *data++ = color & 0x7F;
+  }
+  for (; iLED < ringLEDs; iLED++) {*data++ = 0; *data++ = 0; *data++ = 0;}
+  *SlotSeq(iSlot) = 2 * frame;
+
+  ringFrames = frame;
+  publishMicros = micros() - startMicros;
+}
+
+/*_____________________________
+LEDSegsFrameReader::ReadLatest
+Copy the newest frame (3 * LEDs bytes, RGB) into Frame. See cFrameNone/Read/Torn.
+*/
+
+short LEDSegsFrameReader::ReadLatest(byte Frame[]) {
+  unsigned long frame, seq;
+  short iSlot, iByte, nBytes;
+  volatile byte *data;
+
+  frame = LEDSegsFrameRing::ReadLong(&ring.ringFrames);
+  if (frame == lastFrame) {return cFrameNone;}
+
+  //Check the slot still holds that frame before and after copying it
+  iSlot = (frame - 1) % ring.ringSlots;
+  seq = LEDSegsFrameRing::ReadLong(ring.SlotSeq(iSlot));
+  if (seq != (2 * frame)) {return cFrameTorn;}
+
+  data = ring.SlotData(iSlot);
+  nBytes = 3 * ring.ringLEDs;
+  for (iByte = 0; iByte < nBytes; iByte++) {Frame[iByte] = *data++;}
+  if (LEDSegsFrameRing::ReadLong(ring.SlotSeq(iSlot)) != seq) {return cFrameTorn;}
+
+  missedFrames += frame - lastFrame - 1;
+  lastFrame = frame;
+  return cFrameRead;
+}
+
+/*_______________________________
+LEDSegsLatencyHistogram::Reset
+*/
+
+void LEDSegsLatencyHistogram::Reset() {
+  short iBucket;
+
+  for (iBucket = 0; iBucket < cLatencyBuckets; iBucket++) {buckets[iBucket] = 0;}
+}
+
+/*_____________________________
+LEDSegsLatencyHistogram::Add
+Count a latency. When a bucket is full, all are halved so the shape is kept.
+*/
+
+void LEDSegsLatencyHistogram::Add(unsigned long Micros) {
+  short iBucket;
+
+  iBucket = min(Micros / cLatencyBucketMicros, (unsigned long) (cLatencyBuckets - 1));
+  if (buckets[iBucket] == 0xFFFF) {
+    for (iBucket = 0; iBucket < cLatencyBuckets; iBucket++) {buckets[iBucket] >>= 1;}
+    iBucket = min(Micros / cLatencyBucketMicros, (unsigned long) (cLatencyBuckets - 1));
+  }
+  buckets[iBucket]++;
+}
+
+/*____________________________________
+LEDSegsLatencyHistogram::Percentile
+Latency in microseconds (the top of its bucket) that Percent of those counted were within. 0 if none.
+*/
+
+unsigned long LEDSegsLatencyHistogram::Percentile(byte Percent) {
+  short iBucket;
+  unsigned long total, target, count;
+
+  total = 0;
+  for (iBucket = 0; iBucket < cLatencyBuckets; iBucket++) {total += buckets[iBucket];}
+  if (total == 0) {return 0;}
+
+  target = ((total * min(Percent, (byte) 100)) + 99) / 100;
+  if (target == 0) {target = 1;}
+  count = 0;
+  for (iBucket = 0; iBucket < (cLatencyBuckets - 1); iBucket++) {
+    count += buckets[iBucket];
+    if (count >= target) {break;}
+  }
+  return ((unsigned long) (iBucket + 1)) * cLatencyBucketMicros;
+}
+
+LEDSegsLatencyProbe* LEDSegsLatencyProbe::firstStarted = NULL;
+
+/*________________________________________
+LEDSegsLatencyProbe::LEDSegsLatencyProbe
+*/
+
+LEDSegsLatencyProbe::LEDSegsLatencyProbe(short WatchLED, unsigned short PeriodMS) {
+  watchLED = WatchLED;
+  periodMS = PeriodMS;
+  nextStarted = NULL;
+  probeStrip = NULL;
+  savedSource = NULL;
+  sinkStrip = NULL;
+  impulsePending = false;
+  impulses = 0;
+  missed = 0;
+}
+
+/*__________________________
+LEDSegsLatencyProbe::Start
+Take over the strip's spectrum source and start the impulses after one period of silence
+*/
+
+void LEDSegsLatencyProbe::Start(LEDSegs* strip) {
+  if (probeStrip != NULL) {Stop(probeStrip);}
+  if ((sinkStrip != strip) && strip->AddSink(this)) {sinkStrip = strip;}
+  probeStrip = strip;
+  nextStarted = firstStarted;
+  firstStarted = this;
+  impulsePending = false;
+  nextImpulseMS = millis() + periodMS;
+  savedSource = strip->GetSpectrumSource();
+  strip->SetSpectrumSource(&SpectrumLevel);
+}
+
+/*_________________________
+LEDSegsLatencyProbe::Stop
+Give the strip back the spectrum source it had before Start. The probe stays a sink but ignores frames.
+*/
+
+void LEDSegsLatencyProbe::Stop(LEDSegs* strip) {
+  LEDSegsLatencyProbe **link;
+
+  if ((probeStrip == NULL) || (strip != probeStrip)) {return;}
+  for (link = &firstStarted; *link != NULL; link = &(*link)->nextStarted) {
+    if (*link == this) {*link = nextStarted; break;}
+  }
+  probeStrip = NULL;
+  strip->SetSpectrumSource(savedSource);
+}
+
+/*__________________________________
+LEDSegsLatencyProbe::SpectrumLevel
+The strip's spectrum source while started: silence, or full level during an impulse. Starts an impulse when
+one is due and the last has been answered.
+*/
+
+short LEDSegsLatencyProbe::SpectrumLevel(LEDSegs* strip, short /*iChannel*/, short /*iBand*/) {
+  LEDSegsLatencyProbe *probe;
+
+  for (probe = firstStarted; (probe != NULL) && (probe->probeStrip != strip); probe = probe->nextStarted) {}
+  if (probe == NULL) {return 0;}
+
+  if (!probe->impulsePending && ((long) (millis() - probe->nextImpulseMS) >= 0)) {
+    probe->impulsePending = true;
+    probe->impulseMicros = micros();
+    probe->impulses++;
+  }
+  if (probe->impulsePending && ((micros() - probe->impulseMicros) < (cProbeImpulseMS * 1000UL))) {return 1023;}
+  return 0;
+}
+
+/*_______________________________
+LEDSegsLatencyProbe::FrameShown
+The strip has been sent, so if the watched LED is lit, that's the response to the impulse
+*/
+
+void LEDSegsLatencyProbe::FrameShown(LEDSegs* strip) {
+  unsigned long elapsed;
+
+  if ((probeStrip != strip) || !impulsePending) {return;}
+
+  elapsed = micros() - impulseMicros;
+  if (strip->GetLEDColor(watchLED) != RGBOff) {latencyHist.Add(elapsed);}
+  else if (elapsed < (cProbeTimeoutMS * 1000UL)) {return;}
+  else {missed++;}
+
+  impulsePending = false;
+  nextImpulseMS = millis() + periodMS;
+}
+
+/*_____________________
+LEDSegsLayout::AddRun
+Add nLEDs logical LEDs mapped to physical LEDs from PhysicalFirst up, or down if Reversed. A PhysicalFirst
+of -1 adds LEDs that aren't shown. Returns false if the spans run out.
+*/
+
+bool LEDSegsLayout::AddRun(short PhysicalFirst, short nLEDs, bool Reversed) {
+  short iLED;
+
+  for (iLED = 0; iLED < nLEDs; iLED++) {
+    if (!AddLED((PhysicalFirst < 0) ? -1 : (Reversed ? (PhysicalFirst - iLED) : (PhysicalFirst + iLED)))) {return false;}
+  }
+  return true;
+}
+
+/*______________________
+LEDSegsLayout::AddGrid
+Add a Width x Height grid wired from PhysicalFirst, as described by the cLayout... Options. Each logical LED
+is looked up in the wiring in turn, so spans are only as short as the numbering and wiring make them.
+*/
+
+bool LEDSegsLayout::AddGrid(short Width, short Height, short PhysicalFirst, short Options) {
+  short iLED, x, y, line, pos, lineLen;
+
+  gridFirst = nLogical;
+  gridWidth = Width;
+  gridHeight = Height;
+  gridOptions = Options;
+
+  for (iLED = 0; iLED < (Width * Height); iLED++) {
+    if (Options & cLayoutColumnMajor) {x = iLED / Height; y = iLED % Height;}
+    else {x = iLED % Width; y = iLED / Width;}
+
+    //Which wired line (row or column) the point is on, and where along it
+    if (Options & cLayoutColumnWired) {line = x; pos = y; lineLen = Height;}
+    else {line = y; pos = x; lineLen = Width;}
+    if ((Options & cLayoutSerpentine) && (line & 1)) {pos = lineLen - 1 - pos;}
+
+    if (!AddLED(PhysicalFirst + (line * lineLen) + pos)) {return false;}
+  }
+  return true;
+}
+
+/*_____________________
+LEDSegsLayout::AddLED
+Add the next logical LED, extending the last span if the physical LED continues it
+*/
+
+bool LEDSegsLayout::AddLED(short Physical) {
+  LEDSegsLayoutSpan *span;
+
+  if (nSpans > 0) {
+    span = &spans[nSpans - 1];
+    if ((Physical < 0) && (span->physicalFirst < 0)) {span->nLEDs++; nLogical++; return true;}
+    if ((Physical >= 0) && (span->physicalFirst >= 0)) {
+      if ((span->nLEDs > 0) && (Physical == (span->physicalFirst + span->nLEDs))) {span->nLEDs++; nLogical++; return true;}
+      if ((span->nLEDs < 0) && (Physical == (span->physicalFirst + span->nLEDs))) {span->nLEDs--; nLogical++; return true;}
+      if ((span->nLEDs == 1) && (Physical == (span->physicalFirst - 1))) {span->nLEDs = -2; nLogical++; return true;}
+    }
+  }
+
+  if (nSpans >= maxSpans) {return false;}
+  span = &spans[nSpans++];
+  span->logicalFirst = nLogical++;
+  span->physicalFirst = max(Physical, (short) -1);
+  span->nLEDs = 1;
+  return true;
+}
+
+/*_______________________
+LEDSegsLayout::FindSpan
+Index of the span holding a logical LED (binary search), or -1 if it's outside the layout
+*/
+
+short LEDSegsLayout::FindSpan(short iLogical) {
+  short low, high, mid;
+
+  if ((iLogical < 0) || (iLogical >= nLogical)) {return -1;}
+  low = 0;
+  high = nSpans - 1;
+  while (low < high) {
+    mid = (low + high + 1) >> 1;
+    if (spans[mid].logicalFirst <= iLogical) {low = mid;} else {high = mid - 1;}
+  }
+  return low;
+}
+
+/*__________________________
+LEDSegsLayout::GetPhysical
+The physical LED for a logical one, or -1 if it isn't shown
+*/
+
+short LEDSegsLayout::GetPhysical(short iLogical) {
+  short iSpan;
+  LEDSegsLayoutSpan *span;
+
+  iSpan = FindSpan(iLogical);
+  if (iSpan < 0) {return -1;}
+  span = &spans[iSpan];
+  if (span->physicalFirst < 0) {return -1;}
+  if (span->nLEDs > 0) {return span->physicalFirst + (iLogical - span->logicalFirst);}
+  return span->physicalFirst - (iLogical - span->logicalFirst);
 }
 #endif  //_LEDSEGS_
 
@@ -0,0 +1,273 @@
+
+//Define this library if not already defined
+#ifndef _LEDSEGSE131_
+  #define _LEDSEGSE131_ 33
+
+/*
+E1.31 (sACN) network output for LEDSegs [SGD]
+
+This sends each frame shown on an LEDSegs strip to Ethernet pixel controllers as E1.31 "streaming
+ACN" DMX universes, in addition to (or instead of) the LPD8806 strips on the board. It is a separate
+file so sketches that don't use it don't need a network library.
+
+It works with any Arduino UDP class -- EthernetUDP for the Ethernet shield, WiFiUDP, etc. Note the
+Ethernet shield uses pin 4 for its SD card select, which is also the spectrum shield's strobe pin. Don't
+use the SD card.
+
+  #include <SPI.h>
+  #include <Ethernet.h>
+  #include <EthernetUdp.h>
+  #include "LEDSegsE131.cpp"
+
+  byte mac[6] = {0x90, 0xA2, 0xDA, 0x00, 0x12, 0x34};   //Your board's MAC
+  EthernetUDP udp;
+  LEDSegsE131 e131(udp, IPAddress(192, 168, 1, 50), 1, mac);  //Controller address, first universe, MAC
+
+  void setup() {
+    Ethernet.begin(mac, IPAddress(192, 168, 1, 20));
+    udp.begin(cE131Port);
+    strip = new LEDSegs(480);
+    strip->AddSink(&e131);
+    ...
+  }
+
+Pixels are packed 170 to a universe (510 channels, RGB), in logical strip order, starting at the
+given universe number. 7-bit LEDSegs colors are scaled to 0..255. At most cE131MaxUniverses universes
+are sent (define it before the #include to change it). Pixels past that are not sent, and
+GetUniversesDropped() returns how many universes they would have needed.
+
+Every E1.31 source has a 16-byte component ID (CID), which receivers use to tell sources apart when
+merging. It is made from the MAC passed to the constructor, so each board has its own. SetCID() sets
+a full UUID instead.
+
+Only universes that changed since they were last sent go out, so a mostly static display is cheap.
+Every universe is re-sent at least every cE131KeepAliveMS anyway, since receivers treat a universe
+that goes quiet as lost. Changes are detected with a CRC-16 of each universe's data rather than by
+keeping a copy of it. Reordered bytes and full-on/off changes always change the CRC, but a change can
+still (very rarely) give the same CRC, and then it waits for the next keep-alive.
+
+All the data packets for a frame carry a synchronization address, and a sync packet follows them.
+Receivers that support synchronization hold each universe until the sync arrives, so the whole frame
+changes at once. Receivers that don't just ignore it. The sync address is the universe just before the
+first one, or just past the last one the sink can send when the first is universe 1. SetSyncUniverse()
+changes it (0 turns sync packets off).
+
+GetUniversesSent() returns the number of data packets sent for the last frame, and GetSendMicros()
+the time it took to pack and send them.
+
+The E131LoopbackCheck sketch runs this sink against a stand-in receiver that validates each packet.
+*/
+
+#include <Udp.h>
+#include <IPAddress.h>
+
+const unsigned short cE131Port = 5568;            //The E1.31 UDP port
+const short cE131PixelsPerUniverse = 170;         //510 of the 512 DMX slots, as RGB
+const unsigned short cE131KeepAliveMS = 1000;     //Max time between sends of an unchanged universe
+const byte cE131Priority = 100;                   //Default E1.31 priority
+const unsigned short cE131LastUniverse = 63999;   //Universes (and sync addresses) are 1..63999
+
+//Max # of universes (170 pixels each) one LEDSegsE131 sink can send
+
+#ifndef cE131MaxUniverses
+  #define cE131MaxUniverses 8
+#endif
+
+class LEDSegsE131 : public LEDSegsSink {
+
+  public:
+
+    LEDSegsE131(UDP &Udp, IPAddress Destination, unsigned short FirstUniverse, const byte MAC[6]);
+    void FrameShown(LEDSegs* strip);
+
+    void SetSyncUniverse(unsigned short Universe) {syncUniverse = Universe;}  //1..63999, or 0 for no sync packets
+    void SetCID(const byte CID[16]) {memcpy(&packet[22], CID, 16);}
+    short GetUniversesSent() {return universesSent;}
+    short GetUniversesDropped() {return universesDropped;}
+    unsigned long GetSendMicros() {return sendMicros;}
+
+  private:
+    //Data packet header length (up to the DMX data) and sync packet length
+    const static short cE131DataHeaderLen = 126;
+    const static short cE131SyncLen = 49;
+
+    void InitDataHeader(const byte[]);
+    void SendSync();
+    static void PutShort(byte[], unsigned short);
+
+    //One byte of a CRC-16-CCITT (polynomial 0x1021)
+    static unsigned short CRCByte(unsigned short crc, byte value) {
+      crc = (crc >> 8) | (crc << 8);
+      crc ^= value;
+      crc ^= (crc & 0xFF) >> 4;
+      crc ^= crc << 12;
+      crc ^= (crc & 0xFF) << 5;
+      return crc;
+    }
+
+    UDP &udp;
+    IPAddress destination;
+    unsigned short firstUniverse, syncUniverse;
+
+    byte packet[cE131DataHeaderLen + (3 * cE131PixelsPerUniverse)];
+    byte sequence[cE131MaxUniverses];
+    byte syncSequence;
+    unsigned short lastCRC[cE131MaxUniverses];     //CRC of each universe's data when last sent
+    unsigned long lastSentMS[cE131MaxUniverses];
+    bool neverSent[cE131MaxUniverses];
+
+    short universesSent, universesDropped;
+    unsigned long sendMicros;
+};
+
+/*_____________________________
+LEDSegsE131::LEDSegsE131
+Sync packets default to the universe just before FirstUniverse, or if that's universe 1, the one just past
+the last universe this sink can send. MAC is the board's, to make a CID unique to it.
+*/
+
+LEDSegsE131::LEDSegsE131(UDP &Udp, IPAddress Destination, unsigned short FirstUniverse, const byte MAC[6]) : udp(Udp) {
+  short iUniverse;
+
+  destination = Destination;
+  firstUniverse = FirstUniverse;
+  if (FirstUniverse > 1) {syncUniverse = FirstUniverse - 1;}
+  else {syncUniverse = min((unsigned long) FirstUniverse + cE131MaxUniverses, (unsigned long) cE131LastUniverse);}
+  syncSequence = 0;
+  for (iUniverse = 0; iUniverse < cE131MaxUniverses; iUniverse++) {
+    sequence[iUniverse] = 0;
+    neverSent[iUniverse] = true;
+  }
+  universesSent = 0;
+  universesDropped = 0;
+  sendMicros = 0;
+  InitDataHeader(MAC);
+}
+
+/*__________________________
+LEDSegsE131::InitDataHeader
+Fill in the parts of the data packet header that never change
+*/
+
+void LEDSegsE131::InitDataHeader(const byte MAC[]) {
+  static const byte acnId[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+  static const byte cidPrefix[10] = {'L', 'E', 'D', 'S', 'e', 'g', 's', 0, 0xE1, 0x31};
+  static const char sourceName[] = "LEDSegs";
+
+  memset(packet, 0, cE131DataHeaderLen);
+
+  //Root layer
+  PutShort(&packet[0], 0x0010);  //Preamble size
+  memcpy(&packet[4], acnId, sizeof(acnId));
+  packet[21] = 0x04;              //VECTOR_ROOT_E131_DATA
+  memcpy(&packet[22], cidPrefix, sizeof(cidPrefix));  //Component ID: the prefix, then the board's MAC
+  memcpy(&packet[32], MAC, 6);
+
+  //Framing layer
+  packet[43] = 0x02;              //VECTOR_E131_DATA_PACKET
+  memcpy(&packet[44], sourceName, sizeof(sourceName));
+  packet[108] = cE131Priority;
+
+  //DMP layer
+  packet[117] = 0x02;             //VECTOR_DMP_SET_PROPERTY
+  packet[118] = 0xA1;             //Address & data type
+  PutShort(&packet[121], 0x0001); //Address increment
+}
+
+/*_______________________
+LEDSegsE131::FrameShown
+Pack the frame into universes and send the ones that changed, then the sync packet
+*/
+
+void LEDSegsE131::FrameShown(LEDSegs* strip) {
+  short iUniverse, nUniverses, iLED, firstLED, endLED, nSlots, packetLen;
+  unsigned short crc;
+  unsigned long startMicros, nowMS;
+  uint32_t color;
+  byte *data, value;
+
+  startMicros = micros();
+  nowMS = millis();
+  universesSent = 0;
+
+  nUniverses = (strip->GetNumLEDs() + cE131PixelsPerUniverse - 1) / cE131PixelsPerUniverse;
+  universesDropped = max(nUniverses - cE131MaxUniverses, 0);
+  nUniverses = min(nUniverses, cE131MaxUniverses);
+
+  for (iUniverse = 0; iUniverse < nUniverses; iUniverse++) {
+    firstLED = iUniverse * cE131PixelsPerUniverse;
+    endLED = min(firstLED + cE131PixelsPerUniverse, strip->GetNumLEDs());
+
+    //Pack the RGB data, taking its CRC as we go
+    data = &packet[cE131DataHeaderLen];
+    crc = 0xFFFF;
+    for (iLED = firstLED; iLED < endLED; iLED++) {
+      color = strip->GetLEDColor(iLED);
+      value = (color >> 8) & 0x7F;  *data = (value << 1) | (value >> 6); crc = CRCByte(crc, *data++);
+      value = (color >> 16) & 0x7F; *data = (value << 1) | (value >> 6); crc = CRCByte(crc, *data++);
+      value = color & 0x7F;         *data = (value << 1) | (value >> 6); crc = CRCByte(crc, *data++);
+    }
+
+    //Skip it if nothing changed and the receiver has heard from us recently
+    if (!neverSent[iUniverse] && (crc == lastCRC[iUniverse]) && ((nowMS - lastSentMS[iUniverse]) < cE131KeepAliveMS)) {continue;}
+
+    //Fill in the lengths and per-packet fields
+    nSlots = 3 * (endLED - firstLED);
+    packetLen = cE131DataHeaderLen + nSlots;
+    PutShort(&packet[16], 0x7000 | (packetLen - 16));
+    PutShort(&packet[38], 0x7000 | (packetLen - 38));
+    PutShort(&packet[109], syncUniverse);
+    packet[111] = sequence[iUniverse]++;
+    PutShort(&packet[113], firstUniverse + iUniverse);
+    PutShort(&packet[115], 0x7000 | (packetLen - 115));
+    PutShort(&packet[123], nSlots + 1);  //Property count includes the start code
+
+    udp.beginPacket(destination, cE131Port);
+    udp.write(packet, packetLen);
+    udp.endPacket();
+
+    lastCRC[iUniverse] = crc;
+    lastSentMS[iUniverse] = nowMS;
+    neverSent[iUniverse] = false;
+    universesSent++;
+  }
+
+  if ((universesSent > 0) && (syncUniverse != 0)) {SendSync();}
+  sendMicros = micros() - startMicros;
+}
+
+/*_____________________
+LEDSegsE131::SendSync
+Send an E1.31 synchronization packet telling receivers to show the universes just sent
+*/
+
+void LEDSegsE131::SendSync() {
+  byte sync[cE131SyncLen];
+
+  //Same root layer as the data packets except for length and vector
+  memcpy(sync, packet, 38);
+  PutShort(&sync[16], 0x7000 | (cE131SyncLen - 16));
+  sync[21] = 0x08;                //VECTOR_ROOT_E131_EXTENDED
+
+  PutShort(&sync[38], 0x7000 | (cE131SyncLen - 38));
+  sync[40] = 0; sync[41] = 0; sync[42] = 0;
+  sync[43] = 0x01;                //VECTOR_E131_EXTENDED_SYNCHRONIZATION
+  sync[44] = syncSequence++;
+  PutShort(&sync[45], syncUniverse);
+  sync[47] = 0; sync[48] = 0;     //Reserved
+
+  udp.beginPacket(destination, cE131Port);
+  udp.write(sync, cE131SyncLen);
+  udp.endPacket();
+}
+
+/*_____________________
+LEDSegsE131::PutShort
+Store a 16-bit value in network (big-endian) order
+*/
+
+void LEDSegsE131::PutShort(byte Dest[], unsigned short Value) {
+  Dest[0] = Value >> 8;
+  Dest[1] = Value & 0xFF;
+}
+#endif  //_LEDSEGSE131_
@@ -0,0 +1,76 @@
+//Measures how LEDSegsScheduler scales with the number of strips. For 1, 2, 4 and 8 strips it runs the
+//scheduler for a few seconds and prints the load, the missed deadlines, and the stepped display routine
+//overruns on the serial port (115200 baud). Nothing needs to be connected: the strips have no outputs
+//and a stand-in spectrum source, so this measures the display cycles alone.
+//
+//Copy (or link) LEDSegs.cpp into this folder first, as the Arduino IDE only builds the sketch's own folder.
+
+#include <SPI.h>
+#include "LEDSegs.cpp"
+
+const short nLEDsPerStrip = 160;
+const unsigned short periodMS = 30;        //Each strip's refresh period
+const unsigned long runMS = 5000UL;        //How long to run each strip count
+const short stripCounts[] = {1, 2, 4, 8};
+
+//A slowly moving level for every band, so the segments have something to do
+short levelRamp(LEDSegs* /*strip*/, short /*iChannel*/, short iBand) {return ((millis() / 8) + (iBand * 140)) % 1024;}
+
+void RunStrips(short nStrips) {
+  LEDSegsScheduler scheduler;
+  LEDSegs* strips[cMaxScheduledStrips];
+  LEDSegsStats stats;
+  unsigned long startMS, frames, overruns, misses;
+  short iStrip;
+
+  for (iStrip = 0; iStrip < nStrips; iStrip++) {
+    strips[iStrip] = new LEDSegs(nLEDsPerStrip);
+    strips[iStrip]->SetSpectrumSource(&levelRamp);
+    strips[iStrip]->DefineSegment(0, 40, cSegActionFromBottom, RGBRed, cSegBand1);
+    strips[iStrip]->DefineSegment(40, 40, cSegActionFromTop, RGBGreen, cSegBand3);
+    strips[iStrip]->DefineSegment(80, 40, cSegActionFromMiddle, RGBBlue, cSegBand5);
+    strips[iStrip]->DefineSegment(120, 40, cSegActionFromBottom, RGBYellow, cSegBand7);
+    scheduler.AddStrip(strips[iStrip], periodMS, true, true);
+  }
+
+  scheduler.ResetStats();
+  startMS = millis();
+  while ((millis() - startMS) < runMS) {scheduler.Run();}
+
+  frames = 0;
+  overruns = 0;
+  misses = 0;
+  for (iStrip = 0; iStrip < nStrips; iStrip++) {
+    strips[iStrip]->GetStats(stats);
+    frames += stats.frames;
+    overruns += stats.routineOverruns;
+    misses += scheduler.GetDeadlineMisses(iStrip);
+  }
+
+  Serial.print(nStrips);
+  Serial.print(" strips: load ");
+  Serial.print(scheduler.GetLoadPercent());
+  Serial.print("%, frames ");
+  Serial.print(frames);
+  Serial.print(", deadline misses ");
+  Serial.print(misses);
+  Serial.print(", routine overruns ");
+  Serial.println(overruns);
+
+  for (iStrip = 0; iStrip < nStrips; iStrip++) {delete strips[iStrip];}
+}
+
+void setup() {
+  short i;
+
+  Serial.begin(115200);
+  Serial.print("LEDSegsScheduler check: ");
+  Serial.print(nLEDsPerStrip);
+  Serial.print(" LEDs per strip, ");
+  Serial.print(periodMS);
+  Serial.println("ms period");
+  for (i = 0; i < (short) SIZEOF_ARRAY(stripCounts); i++) {RunStrips(stripCounts[i]);}
+}
+
+void loop() {
+}